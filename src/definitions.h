@@ -4,9 +4,14 @@
 #include <mpi.h>
 #include <time.h>
 
+// The element type used by the persistent memory tasks, float or double (set with
+// -DSTREAM_TYPE=float). The main memory task selects its element types at runtime
+// from the data_types table instead. The table entry used by the tasks follows from
+// STREAM_TYPE, so the two always agree, and any other type fails to compile.
 #ifndef STREAM_TYPE
 #define STREAM_TYPE double
 #endif
+#define STREAM_DATA_TYPE _Generic((STREAM_TYPE)0, float: float_type, double: double_type)
 
 # ifndef MIN
 # define MIN(x,y) ((x)<(y)?(x):(y))
@@ -24,55 +29,434 @@ typedef enum {
 	collective
 } persist_state;
 
+typedef enum {
+	regular_stores,
+	streaming_stores
+} store_state;
+
+// Where the memory task arrays are placed. first_touch leaves it to the operating system
+// (normally the NUMA domain of the thread that first writes each page), the others are
+// only available when built with NUMA support.
+typedef enum {
+	first_touch,
+	local_placement,
+	interleaved_placement,
+	node_placement
+} placement_state;
+
+// The most NUMA domains that placement is recorded for, and that the NUMA matrix covers
+#define MAX_NUMA_DOMAINS 64
+
+// The pages the memory task arrays are allocated with. default_pages uses malloc, so whether
+// transparent huge pages are used depends on the settings of the node. The others map the
+// arrays directly: small_pages asks for no huge pages, madvise_huge_pages asks for transparent
+// huge pages, the hugetlb modes use explicit huge pages from the pool of the node, and
+// hugetlbfs_pages maps a file on a hugetlbfs mount.
+typedef enum {
+	default_pages,
+	small_pages,
+	madvise_huge_pages,
+	hugetlb_2m_pages,
+	hugetlb_1g_pages,
+	hugetlbfs_pages
+} page_mode;
+
+#define DEFAULT_HUGETLBFS_PATH "/dev/hugepages"
+
+// The default offset, in elements, between the arrays of the memory task (the offset and the
+// alignment of the arrays can be changed at runtime)
+#ifndef OFFSET
+#	define OFFSET	0
+#endif
+
 typedef struct communicator {
 	MPI_Comm comm;
 	int rank;
 	int size;
 } communicator;
 
+// Number of percentiles of the bandwidth reported, listed in bandwidth_percentiles
+#define NUM_PERCENTILES 4
+
 typedef struct performance_result {
 	double avg;
 	double min;
 	double max;
 	double *raw_result;
+	// Time taken by each thread for each repeat (repeat major), only allocated when the
+	// threads are being timed
+	double *thread_raw_result;
+	// Thread imbalance (slowest thread time over the mean thread time), averaged over the
+	// repeats, and the worst repeat. Zero if the threads were not timed.
+	double imbalance;
+	double max_imbalance;
+	// Half the width of the 95% confidence interval of the node time over its mean, only set
+	// for the node results (zero if there were too few repeats to estimate it)
+	double confidence;
+	// Times at the bandwidth_percentiles of the bandwidth (so the slowest first), estimated from
+	// quantile sketches of the times of all the processes and repeats, only set for the node
+	// results
+	double percentiles[NUM_PERCENTILES];
+	// Set when the task has run this kernel, as not all tasks implement all kernels
+	// and kernels can be switched off at runtime.
+	int used;
 } performance_result;
 
+// Where an OpenMP thread was running when the kernels started and when they finished,
+// -1 if it was not recorded
+typedef struct thread_placement {
+	int start_cpu;
+	int start_socket;
+	int end_cpu;
+	int end_socket;
+} thread_placement;
+
+// Per process (or per node) results, with one performance_result for each
+// kernel in the kernel registry.
 typedef struct benchmark_results {
-	struct performance_result Copy;
-	struct performance_result Scale;
-	struct performance_result Add;
-	struct performance_result Triad;
+	struct performance_result *results;
+	// Elements in each array for each process, which can differ between nodes
+	size_t array_size;
+	// Sampled pages of the arrays found on each NUMA domain, summed over the node
+	double numa_pages[MAX_NUMA_DOMAINS];
+	// The pages the arrays were allocated with, and how much of the arrays was resident and
+	// how much of that was on huge pages (in bytes, summed over the node)
+	page_mode pages;
+	double huge_page_bytes;
+	double resident_bytes;
+	// Time to start and finish a parallel region, and for a barrier across the threads of a
+	// process, in seconds (the slowest process of the node)
+	double fork_join_time;
+	double team_barrier_time;
+	// Repeats actually run, including the first (uncounted) one, which the adaptive mode can
+	// change for each node
+	int repeats;
+	// Time taken to validate the results, in seconds, kept apart from the kernel times (for
+	// the node, the slowest process). Negative if the results were not validated.
+	double validation_time;
+	// Placement of each of the OpenMP threads of the process
+	thread_placement *threads;
+	int num_threads;
 	char name[MPI_MAX_PROCESSOR_NAME];
 } benchmark_results;
 
+// Results of the latency task for a node, all the latencies are in nanoseconds per load
+typedef struct latency_results {
+	double idle_latency;
+	double idle_min;
+	double loaded_latency;
+	double loaded_min;
+	// Node bandwidth of the Triad kernel run by the other processes during the loaded measurement
+	double loaded_bandwidth;
+	char name[MPI_MAX_PROCESSOR_NAME];
+} latency_results;
+
+// Most points of the interference task, including the unloaded baseline
+#define MAX_LOAD_POINTS 17
+
+// Results of the interference task for a node. Point 0 is the baseline, with the generators
+// idle, and the others the load fractions asked for. All the bandwidths are node bandwidths
+// in MB/s.
+typedef struct interference_results {
+	int num_points;
+	// Load of each point, as a percentage of the generators' peak bandwidth
+	int fractions[MAX_LOAD_POINTS];
+	// Triad bandwidth of the generators running flat out on their own
+	double peak_bandwidth;
+	// Bandwidth the generators achieved at each point
+	double generated[MAX_LOAD_POINTS];
+	// Bandwidth of each kernel on the measuring processes at each point (point major)
+	double *bandwidths;
+	char name[MPI_MAX_PROCESSOR_NAME];
+} interference_results;
+
+// Robust z-score a node's measurement has to fall below to be reported as anomalous, unless set with -H
+#define DEFAULT_OUTLIER_THRESHOLD 3.5
+// A flagged measurement also has to be this fraction worse than the median node, so a very uniform
+// set of nodes does not turn tiny differences into large z-scores
+#define MIN_OUTLIER_DEVIATION 0.05
+// Fewest nodes the outlier analysis is run over, the median and MAD mean little with fewer
+#define MIN_OUTLIER_NODES 3
+#define MAX_MEASUREMENT_NAME 128
+#define DEFAULT_EXCLUSION_FILE "excluded_nodes.txt"
+
+// Nodes found to be anomalous by the outlier analysis, kept on the root across all the tasks run.
+// For each node the lowest robust z-score of any of its measurements (negative is worse, whatever
+// was measured), the measurement it came from, and how many of its measurements were flagged.
+typedef struct outlier_results {
+	double threshold;
+	int num_nodes;
+	int num_measurements;
+	double *scores;
+	int *counts;
+	char (*measurements)[MAX_MEASUREMENT_NAME];
+	char (*names)[MPI_MAX_PROCESSOR_NAME];
+} outlier_results;
+
 typedef struct aggregate_results {
-	struct performance_result Copy;
-	struct performance_result Scale;
-	struct performance_result Add;
-	struct performance_result Triad;
-	char copy_max[MPI_MAX_PROCESSOR_NAME];
-	char scale_max[MPI_MAX_PROCESSOR_NAME];
-	char add_max[MPI_MAX_PROCESSOR_NAME];
-	char triad_max[MPI_MAX_PROCESSOR_NAME];
+	struct performance_result *results;
+	char (*max_names)[MPI_MAX_PROCESSOR_NAME];
+	// Where the worst thread imbalance was seen (a process or a node name)
+	char (*imbalance_names)[MPI_MAX_PROCESSOR_NAME];
+	// The slowest validation of any node, in seconds, negative if the results were not validated
+	double validation_time;
 } aggregate_results;
 
+// The position of each kernel in the kernel registry
 typedef enum {
   copy,
   scale,
   add,
-  triad
+  triad,
+  sum,
+  dot,
+  fill,
+  nstream,
+  gather_copy,
+  gather_triad,
+  scatter_copy,
+  scatter_triad,
+  strided_copy,
+  strided_triad,
+  streams
 } benchmark_type;
 
-int stream_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, size_t cache_size, int repeats);
+// The position of each element type in the data_types table
+typedef enum {
+  float_type,
+  double_type,
+  int32_type,
+  int64_type,
+  complex_type
+} element_type;
+
+// A kernel computing dst[j] = f(x[j], y[j], scalar) for j in [0,n). The arrays
+// hold elements of the data type the kernel was built for, and the scalar is
+// converted to that type by the kernel.
+typedef void (*kernel_function)(void *restrict dst, const void *restrict x, const void *restrict y, double scalar, size_t n);
+
+// A kernel computing dst[j] = f(x[index[j]], y[index[j]], scalar) (a gather) or
+// dst[index[j]] = f(x[j], y[j], scalar) (a scatter) for j in [0,n)
+typedef void (*index_kernel_function)(void *restrict dst, const void *restrict x, const void *restrict y, const size_t *restrict index, double scalar, size_t n);
+
+// A kernel computing dst[j] = f(x[j], y[j], scalar) for j in [0,n), visiting the
+// elements stride apart in turn rather than in order
+typedef void (*strided_kernel_function)(void *restrict dst, const void *restrict x, const void *restrict y, double scalar, size_t n, size_t stride);
+
+// A kernel reading the first reads arrays and writing the next writes arrays, for the elements
+// in [start,start+n), returning a value derived from what was read if nothing is written
+typedef double (*multi_stream_function)(void *const *arrays, int reads, int writes, size_t start, size_t n);
+
+// The most arrays the stream count kernel can read, and write, and how many it uses by default
+#define MAX_STREAMS 32
+#define DEFAULT_READ_STREAMS 4
+#define DEFAULT_WRITE_STREAMS 1
+
+typedef struct kernel_set {
+	char *isa;
+	store_state store;
+	int (*available)();
+	kernel_function copy;
+	kernel_function scale;
+	kernel_function add;
+	kernel_function triad;
+	kernel_function fill;
+	kernel_function nstream;
+} kernel_set;
+
+// An element type the kernel engine has been built for, with the kernel sets
+// and the typed helpers the tasks need to set up and validate the arrays.
+typedef struct data_type {
+	char *name;
+	int size;
+	// Kernel sets in order of preference, the last one is always the scalar set
+	kernel_set *kernel_sets;
+	int num_kernel_sets;
+	double (*sum)(const void *x, size_t n);
+	double (*dot)(const void *x, const void *y, size_t n);
+	// Average relative error of x against a single expected value, counting the
+	// elements whose relative error is above epsilon
+	double (*relative_error)(const void *x, const void *expected, size_t n, double epsilon, size_t *errors);
+	// The irregular access kernels, which are only provided as scalar kernels
+	index_kernel_function gather_copy;
+	index_kernel_function gather_triad;
+	index_kernel_function scatter_copy;
+	index_kernel_function scatter_triad;
+	strided_kernel_function strided_copy;
+	strided_kernel_function strided_triad;
+	multi_stream_function multi_stream;
+	double epsilon;
+	int enabled;
+} data_type;
+
+// The arrays and parameters a registered kernel operates on
+typedef struct stream_arrays {
+	void *a;
+	void *b;
+	void *c;
+	double scalar;
+	size_t array_size;
+	data_type *type;
+	kernel_set *kernels;
+	// Index array (a permutation of the elements) for the gather and scatter kernels,
+	// and the distance between the elements visited in turn by the strided kernels
+	size_t *index;
+	size_t stride;
+	// The arrays of the stream count kernel, the read arrays followed by the written ones
+	void **streams;
+	int read_streams;
+	int write_streams;
+	// Result of the read only (reduction) kernels
+	double sum;
+} stream_arrays;
+
+typedef struct benchmark_kernel {
+	char *name;
+	// Number of arrays read and written for each element, the bytes moved
+	// follow from the size of the element type being run
+	int arrays_read;
+	int arrays_written;
+	// Run the kernel over the whole of the arrays
+	void (*run)(stream_arrays *arrays);
+	// Irregular (indexed or strided) kernels also report elements per second, and
+	// are only run by the main memory task
+	int irregular;
+	int enabled;
+} benchmark_kernel;
+
+extern benchmark_kernel kernel_registry[];
+extern const int num_kernels;
+extern data_type data_types[];
+extern const int num_data_types;
+extern const int bandwidth_percentiles[NUM_PERCENTILES];
+
+int enable_kernels(char *kernel_list);
+int enable_data_types(char *type_list);
+double validate_array(data_type *type, void *x, void *expected, size_t array_size, size_t sample, size_t *errors);
+void expected_values(data_type *type, performance_result *results, int repeats, double scalar, void *aj, void *bj, void *cj);
+kernel_set *select_kernel_set(data_type *type, store_state store);
+void get_thread_chunk(size_t array_size, size_t *start, size_t *length);
+void set_thread_times(double *times);
+void run_kernel(kernel_function kernel, void *dst, void *x, void *y, double scalar, size_t array_size, int element_size);
+void run_gather_kernel(index_kernel_function kernel, void *dst, void *x, void *y, size_t *index, double scalar, size_t array_size, int element_size);
+void run_scatter_kernel(index_kernel_function kernel, void *dst, void *x, void *y, size_t *index, double scalar, size_t array_size, int element_size);
+void run_strided_kernel(strided_kernel_function kernel, void *dst, void *x, void *y, double scalar, size_t array_size, int element_size, size_t stride);
+double run_multi_stream_kernel(multi_stream_function kernel, void **arrays, int reads, int writes, size_t array_size);
+void set_stream_counts(int reads, int writes);
+
+// How the index array of the gather and scatter kernels is generated: a random
+// permutation of all the elements, or a random permutation of blocks of
+// contiguous elements
+typedef enum {
+	uniform_index,
+	blocked_index
+} index_distribution;
+
+// Default block size (in elements) of the blocked index distribution, and stride of the strided kernels
+#define DEFAULT_INDEX_BLOCK 512
+#define DEFAULT_STRIDE 8
+// Default number of runs of the first (uncounted) repeat, and the fewest counted repeats the
+// adaptive mode trusts a confidence interval from
+#define DEFAULT_WARMUP 1
+#define MIN_ADAPTIVE_REPEATS 5
+// Elements the arrays are validated in blocks of, and by default the sampled validation checks
+// one block in this many
+#define VALIDATION_BLOCK 4096
+#define DEFAULT_VALIDATION_SAMPLE 16
+// Runtime settings for the main memory task
+typedef struct task_settings {
+	data_type *type;
+	store_state store;
+	placement_state placement;
+	// The NUMA domain used for node_placement
+	int placement_node;
+	page_mode pages;
+	// The hugetlbfs mount used for hugetlbfs_pages
+	char *hugetlbfs_path;
+	// The boundary, in bytes, the arrays are aligned to (zero keeps the alignment of the
+	// allocator), and the offset, in elements, of each array from the one before
+	size_t alignment;
+	size_t offset;
+	// The arrays read and written by the stream count kernel
+	int read_streams;
+	int write_streams;
+	// Run the repeat loop inside a single parallel region rather than a region per kernel
+	int persistent_team;
+	// Times the first repeat (which is not counted) is run before the counted repeats start
+	int warmup;
+	// Target for the relative half width of the 95% confidence interval of each kernel's node
+	// time, and the most time (in seconds, zero for no limit) to spend on the repeats. A zero
+	// target runs the given number of repeats, otherwise that is only the most repeats run.
+	double target_confidence;
+	double time_budget;
+	// Index array and stride used by the irregular kernels
+	index_distribution distribution;
+	size_t index_block;
+	size_t stride;
+	// Time each thread's share of every kernel as well as the whole kernel
+	int thread_timing;
+	// Validate one block of the arrays in every validation blocks after the kernels have run
+	// (1 validates every element, 0 skips the validation)
+	size_t validation;
+	// Print the task configuration before running, switched off for the points of a sweep
+	int verbose;
+} task_settings;
+
+// The shared timer (timer.c)
+void init_timer();
+double mysecond();
+char *timer_name();
+double timer_resolution();
+double timer_overhead();
+
+size_t memory_task_array_size(size_t cache_size, data_type *type, communicator node_comm);
+int stream_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t array_size, task_settings settings, int repeats);
+int stream_interference_task(interference_results *i_results, communicator world_comm, communicator node_comm, size_t array_size, task_settings settings, int generators, int repeats);
+int stream_latency_task(latency_results *l_results, communicator world_comm, communicator node_comm, size_t footprint, size_t array_size, int repeats);
 #ifdef PMEM
-int stream_memkind_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, int socket, size_t cache_size, int repeats, char *pmem_path);
-int stream_persistent_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, int socket, persist_state persist_level, size_t cache_size, int repeats, char *pmem_path);
-int stream_write_persistent_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, int socket, persist_state persist_level, size_t cache_size, int repeats, char *pmem_path);
-int stream_read_persistent_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, int socket, size_t cache_size, int repeats, char *pmem_path);
+int stream_memkind_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, int socket, size_t cache_size, int repeats, char *pmem_path, size_t validation);
+int stream_persistent_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, int socket, persist_state persist_level, size_t cache_size, int repeats, char *pmem_path, size_t validation);
+int stream_write_persistent_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, int socket, persist_state persist_level, size_t cache_size, int repeats, char *pmem_path, size_t validation);
+int stream_read_persistent_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, int socket, size_t cache_size, int repeats, char *pmem_path, size_t validation);
 #endif
 void collect_results(benchmark_results result, aggregate_results *agg_result, aggregate_results *node_results, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm, int repeats);
 void initialise_benchmark_results(benchmark_results *b_results, int repeats);
 void free_benchmark_results(benchmark_results *b_results);
-void collect_individual_result(performance_result indivi, performance_result *result, performance_result *node_result, char *max_name, char *name, benchmark_results *all_node_results, benchmark_type benchmark, communicator world_comm, communicator node_comm, communicator root_comm, int repeats);
-void print_results(aggregate_results a_results, aggregate_results node_results, communicator world_comm, size_t array_size, communicator node_comm);
-void save_results(char *filename, benchmark_results *all_node_results, size_t array_size, communicator world_comm, communicator node_comm, communicator root_comm);
+void summarise_benchmark_results(benchmark_results *b_results, int repeats);
+void summarise_thread_imbalance(performance_result *result, int num_threads, int repeats);
+void initialise_aggregate_results(aggregate_results *a_results);
+void free_aggregate_results(aggregate_results *a_results);
+benchmark_results *initialise_node_results(int num_nodes);
+void free_node_results(benchmark_results *all_node_results);
+void setup_node_groups(communicator root_comm);
+void free_node_groups();
+void gather_nodes(void *send, int bytes, void *recv, communicator root_comm);
+void collect_kernel_results(benchmark_results *b_results, aggregate_results *a_results, aggregate_results *node_results, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm, int repeats);
+void node_best_times(benchmark_results *b_results, communicator comm, double *best_times);
+void print_results(aggregate_results a_results, aggregate_results node_results, communicator world_comm, size_t array_size, int element_size, communicator node_comm);
+void print_store_comparison(aggregate_results regular_results, aggregate_results streaming_results, size_t array_size, int element_size, communicator node_comm);
+void collect_latency_results(latency_results l_results, latency_results *all_node_latencies, communicator node_comm, communicator root_comm);
+void print_latency_results(latency_results *all_node_latencies, size_t footprint, communicator node_comm, communicator root_comm);
+void save_latency_results(char *filename, latency_results *all_node_latencies, size_t footprint, communicator node_comm, communicator root_comm);
+void collect_interference_results(interference_results i_results, interference_results *all_node_interference, communicator node_comm, communicator root_comm);
+void print_interference_results(interference_results *all_node_interference, int generators, communicator node_comm, communicator root_comm);
+void save_interference_results(char *filename, interference_results *all_node_interference, int generators, size_t array_size, data_type *type, communicator node_comm, communicator root_comm);
+void print_numa_placement(benchmark_results *all_node_results, communicator root_comm);
+void initialise_outlier_results(outlier_results *outliers, int num_nodes, double threshold);
+void free_outlier_results(outlier_results *outliers);
+void find_outliers(outlier_results *outliers, double *values, int higher_is_better, char *measurement);
+void find_memory_outliers(outlier_results *outliers, benchmark_results *all_node_results, char *task, char *type_name);
+void find_latency_outliers(outlier_results *outliers, latency_results *all_node_latencies, communicator node_comm);
+int report_outliers(outlier_results *outliers, char *exclusion_file);
+void print_page_coverage(benchmark_results *all_node_results, communicator root_comm);
+void check_node_names(communicator world_comm, communicator node_comm, communicator root_comm);
+void check_thread_placement(benchmark_results b_results, communicator world_comm, communicator node_comm, communicator root_comm);
+void save_results(char *filename, benchmark_results *all_node_results, size_t array_size, data_type *type, communicator world_comm, communicator node_comm, communicator root_comm);
+void memory_sweep(char *filename, task_settings settings, size_t max_array_size, int points_per_doubling, int repeats, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm);
+void memory_offset_sweep(char *filename, task_settings settings, size_t array_size, size_t max_offset, size_t offset_step, int repeats, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm);
+void stream_count_sweep(char *filename, task_settings settings, size_t array_size, int max_reads, int repeats, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm);
+void save_stream_count_results(char *filename, benchmark_results **sweep_node_results, int *sweep_reads, int num_points, int writes, data_type *type, communicator world_comm, communicator node_comm, communicator root_comm);
+void memory_monitor(char *filename, task_settings settings, size_t array_size, double interval, double duration, int repeats, communicator world_comm, communicator node_comm, communicator root_comm);
+void numa_matrix(char *filename, task_settings settings, size_t cache_size, int repeats, communicator world_comm, communicator node_comm, communicator root_comm);
+void save_numa_matrix(char *filename, double *all_node_matrices, char (*node_names)[MPI_MAX_PROCESSOR_NAME], int num_domains, data_type *type, communicator node_comm, communicator root_comm);
+void save_sweep_results(char *filename, benchmark_results **sweep_node_results, size_t *sweep_sizes, size_t *sweep_offsets, int num_points, data_type *type, communicator world_comm, communicator node_comm, communicator root_comm);
@@ -4,18 +4,44 @@
 int main(int argc, char **argv){
 
   int err;
+  int option;
+  int num_args;
   int temp_size, temp_rank;
   MPI_Comm temp_comm;
-  int node_key;
+  node_scope scope = whole_node;
   size_t array_size;
   int socket, core;
   int omp_threads;
   size_t cache_size = 0;
+  unsigned long long llc_size, min_llc_size, max_llc_size;
   int repeats = 0;
+  int type;
+  int sweep_points = 0;
+  size_t max_offset = 0, offset_step = 1;
+  int offset_sweep = 0;
+  int max_read_streams = 0;
+  double monitor_interval = 0, monitor_duration = 0;
+  int load_generators = 0;
+  int min_node_size;
+  char *fraction;
+  interference_results i_results;
+  interference_results *all_node_interference;
+  int thread_support;
+  int matrix = 0;
+  double timer_values[2], max_timer_values[2];
+  size_t latency_footprint = 0;
+  latency_results l_results;
+  latency_results *all_node_latencies;
+  outlier_results outliers;
+  double outlier_threshold = DEFAULT_OUTLIER_THRESHOLD;
+  char *exclusion_file = NULL;
+  int num_flagged = 0;
+  task_settings settings;
   benchmark_results b_results;
   aggregate_results node_results;
   benchmark_results *all_node_results;
   aggregate_results a_results;
+  aggregate_results regular_node_results;
   communicator world_comm, node_comm, root_comm;
   char *filename;
   char *pmem_path;
@@ -31,16 +57,293 @@ int main(int argc, char **argv){
 
   filename = (char *)malloc(sizeof(char)*MAX_FILE_NAME_LENGTH);
 
-  MPI_Init(&argc, &argv);
+  // The persistent team mode makes MPI calls from the master thread of a parallel region
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_support);
+
+  // Optional flags come before the positional parameters:
+  //   -k list  comma separated list of the kernels to run (i.e. copy,triad), by default all are run
+  //   -t list  comma separated list of the element types to run the memory task with (i.e. float,double), by default double
+  //   -s n     sweep the memory task array size from L1 resident up to the full array size, with n points per doubling
+  //   -n mode  NUMA placement of the memory task arrays (local, interleave, or a NUMA domain number), or matrix to
+  //            measure the bandwidth from every CPU domain to every memory domain of each node
+  //   -g dist  index distribution of the gather and scatter kernels, uniform or blocked[:block_elements]
+  //   -d n     stride, in elements, of the strided kernels
+  //   -l kib   run the latency task, pointer chasing through kib KiB, idle and with the rest of the node running Triad
+  //   -p       time every thread of the memory task kernels and report the thread imbalance
+  //   -m mode  pages the memory task arrays are allocated with: 4k, thp, 2m, 1g, or hugetlbfs[:mount], by default malloc is used
+  //   -a bytes boundary the memory task arrays are aligned to (a power of two), by default the alignment of the allocator
+  //   -o n     offset, in elements, of each memory task array from the one before, by default OFFSET
+  //   -O max[:step]  sweep the offset between the arrays from 0 to max elements, in steps of step elements (1 by default)
+  //   -c r[:w] arrays read and written by the Streams kernel (enabled with -k streams), by default 4:1
+  //   -C max   sweep the arrays read by the Streams kernel from 1 to max, with the number written set by -c
+  //   -P       run the memory task kernels in a single persistent OpenMP team rather than a parallel region each
+  //   -w n     run the first (uncounted) repeat of the memory task n times to warm up, by default once
+  //   -A pct[:seconds]  repeat the memory task kernels until the 95% confidence interval of each kernel's node time
+  //            is within pct percent of the mean, or seconds have been spent, with repeats as the most repeats
+  //   -M interval[:duration]  run the memory task every interval seconds, for duration seconds or until stopped,
+  //            appending each node's bandwidth to a rolling monitoring file
+  //   -V mode  validation of the results: full (the default), sample[:n] to check one block in every n (16 by default),
+  //            or none
+  //   -L n[:pct,pct,...]  run the last n processes of each node as Triad traffic generators, paced to each percentage
+  //            of their peak bandwidth (25,50,75,100 by default), while the others measure the kernels
+  //   -N scope what each node communicator (and so each node result) covers: node (the default), socket, or numa
+  //   -H z[:file]  health check: flag the nodes with a robust z-score below -z (3.5 by default) on any measurement,
+  //            write them to file (excluded_nodes.txt by default) and exit with a non-zero code if there are any
+  settings.placement = first_touch;
+  settings.placement_node = 0;
+  settings.distribution = uniform_index;
+  settings.index_block = DEFAULT_INDEX_BLOCK;
+  settings.stride = DEFAULT_STRIDE;
+  settings.thread_timing = 0;
+  settings.pages = default_pages;
+  settings.hugetlbfs_path = DEFAULT_HUGETLBFS_PATH;
+  settings.alignment = 0;
+  settings.offset = OFFSET;
+  settings.read_streams = DEFAULT_READ_STREAMS;
+  settings.write_streams = DEFAULT_WRITE_STREAMS;
+  settings.persistent_team = 0;
+  settings.warmup = DEFAULT_WARMUP;
+  settings.target_confidence = 0;
+  settings.time_budget = 0;
+  settings.validation = 1;
+  i_results.num_points = 0;
+  while((option = getopt(argc, argv, "k:t:s:n:g:d:l:pm:a:o:O:c:C:Pw:A:M:L:V:N:H:")) != -1){
+    switch(option){
+    case 'k':
+      if(enable_kernels(optarg) != 0){
+        printf("Unknown kernel in the kernel list %s. Available kernels are:", optarg);
+        for(err=0; err<num_kernels; err++){
+          printf(" %s", kernel_registry[err].name);
+        }
+        printf("\n");
+        exit(0);
+      }
+      break;
+    case 't':
+      if(enable_data_types(optarg) != 0){
+        printf("Unknown element type in the type list %s. Available types are:", optarg);
+        for(err=0; err<num_data_types; err++){
+          printf(" %s", data_types[err].name);
+        }
+        printf("\n");
+        exit(0);
+      }
+      break;
+    case 's':
+      sweep_points = atoi(optarg);
+      if(sweep_points < 1){
+        printf("Expecting a numerical parameter greater than 0 for the number of sweep points per doubling of the array size. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      break;
+    case 'n':
+#ifdef NUMA
+      if(strcmp(optarg, "local") == 0){
+        settings.placement = local_placement;
+      }else if(strcmp(optarg, "interleave") == 0){
+        settings.placement = interleaved_placement;
+      }else if(strcmp(optarg, "matrix") == 0){
+        matrix = 1;
+      }else if(sscanf(optarg, "%d", &settings.placement_node) == 1 && settings.placement_node >= 0){
+        settings.placement = node_placement;
+      }else{
+        printf("Expecting local, interleave, matrix, or a NUMA domain number for the NUMA placement. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+#else
+      printf("NUMA placement requires the benchmark to be built with NUMA support (make NUMA=1).\n");
+      exit(0);
+#endif
+      break;
+    case 'g':
+      if(strcmp(optarg, "uniform") == 0){
+        settings.distribution = uniform_index;
+      }else if(strncmp(optarg, "blocked", strlen("blocked")) == 0){
+        settings.distribution = blocked_index;
+        if(optarg[strlen("blocked")] == ':' && (sscanf(&optarg[strlen("blocked")+1], "%zu", &settings.index_block) != 1 || settings.index_block < 1)){
+          printf("Expecting a numerical block size greater than 0 for the blocked index distribution. Current parameter is %s.\n", optarg);
+          exit(0);
+        }
+      }else{
+        printf("Expecting uniform or blocked[:block_elements] for the gather and scatter index distribution. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      break;
+    case 'd':
+      if(sscanf(optarg, "%zu", &settings.stride) != 1 || settings.stride < 1){
+        printf("Expecting a numerical parameter greater than 0 for the stride of the strided kernels. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      break;
+    case 'l':
+      if(sscanf(optarg, "%zu", &latency_footprint) != 1 || latency_footprint < 1){
+        printf("Expecting a numerical parameter greater than 0 for the latency task footprint (in KiB). Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      latency_footprint = latency_footprint*1024;
+      break;
+    case 'p':
+      settings.thread_timing = 1;
+      break;
+    case 'm':
+      if(strcmp(optarg, "4k") == 0){
+        settings.pages = small_pages;
+      }else if(strcmp(optarg, "thp") == 0){
+        settings.pages = madvise_huge_pages;
+      }else if(strcmp(optarg, "2m") == 0){
+        settings.pages = hugetlb_2m_pages;
+      }else if(strcmp(optarg, "1g") == 0){
+        settings.pages = hugetlb_1g_pages;
+      }else if(strncmp(optarg, "hugetlbfs", strlen("hugetlbfs")) == 0 && (optarg[strlen("hugetlbfs")] == '\0' || optarg[strlen("hugetlbfs")] == ':')){
+        settings.pages = hugetlbfs_pages;
+        if(optarg[strlen("hugetlbfs")] == ':'){
+          settings.hugetlbfs_path = &optarg[strlen("hugetlbfs")+1];
+        }
+      }else{
+        printf("Expecting 4k, thp, 2m, 1g, or hugetlbfs[:mount] for the pages of the arrays. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      break;
+    case 'a':
+      if(sscanf(optarg, "%zu", &settings.alignment) != 1 || settings.alignment < 1 || (settings.alignment & (settings.alignment - 1)) != 0){
+        printf("Expecting a power of two for the alignment of the arrays (in bytes). Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      break;
+    case 'o':
+      if(sscanf(optarg, "%zu", &settings.offset) != 1){
+        printf("Expecting a numerical parameter for the offset between the arrays (in elements). Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      break;
+    case 'O':
+      err = sscanf(optarg, "%zu:%zu", &max_offset, &offset_step);
+      if(err < 1 || max_offset < 1 || offset_step < 1){
+        printf("Expecting max[:step], both greater than 0, for the offset sweep (in elements). Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      offset_sweep = 1;
+      break;
+    case 'c':
+      err = sscanf(optarg, "%d:%d", &settings.read_streams, &settings.write_streams);
+      if(err < 1 || settings.read_streams < 0 || settings.read_streams > MAX_STREAMS || settings.write_streams < 0 || settings.write_streams > MAX_STREAMS || settings.read_streams + settings.write_streams < 1){
+        printf("Expecting reads[:writes], each between 0 and %d and not both 0, for the arrays of the Streams kernel. Current parameter is %s.\n", MAX_STREAMS, optarg);
+        exit(0);
+      }
+      break;
+    case 'P':
+      settings.persistent_team = 1;
+      break;
+    case 'w':
+      if(sscanf(optarg, "%d", &settings.warmup) != 1 || settings.warmup < 1){
+        printf("Expecting a numerical parameter greater than 0 for the number of warm-up runs. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      break;
+    case 'A':
+      err = sscanf(optarg, "%lf:%lf", &settings.target_confidence, &settings.time_budget);
+      if(err < 1 || settings.target_confidence <= 0 || settings.time_budget < 0){
+        printf("Expecting percent[:seconds], with percent greater than 0, for the adaptive repeats. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      settings.target_confidence = settings.target_confidence/100.0;
+      break;
+    case 'L':
+      if(sscanf(optarg, "%d", &load_generators) != 1 || load_generators < 1){
+        printf("Expecting n[:percent,percent,...], with n greater than 0, for the traffic generators. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      // Point 0 is always the baseline with the generators idle
+      i_results.fractions[0] = 0;
+      i_results.num_points = 1;
+      fraction = strchr(optarg, ':');
+      if(fraction == NULL){
+        for(err=1; err<=4; err++){
+          i_results.fractions[i_results.num_points++] = 25*err;
+        }
+      }else{
+        for(fraction=strtok(fraction+1, ","); fraction != NULL; fraction=strtok(NULL, ",")){
+          if(i_results.num_points == MAX_LOAD_POINTS || sscanf(fraction, "%d", &i_results.fractions[i_results.num_points]) != 1 || i_results.fractions[i_results.num_points] < 1){
+            printf("Expecting up to %d load percentages greater than 0 for the traffic generators. Current parameter is %s.\n", MAX_LOAD_POINTS-1, fraction);
+            exit(0);
+          }
+          i_results.num_points++;
+        }
+      }
+      break;
+    case 'V':
+      if(strcmp(optarg, "full") == 0){
+        settings.validation = 1;
+      }else if(strcmp(optarg, "none") == 0){
+        settings.validation = 0;
+      }else if(strncmp(optarg, "sample", strlen("sample")) == 0){
+        settings.validation = DEFAULT_VALIDATION_SAMPLE;
+        if(optarg[strlen("sample")] == ':' && (sscanf(&optarg[strlen("sample")+1], "%zu", &settings.validation) != 1 || settings.validation < 1)){
+          printf("Expecting a numerical parameter greater than 0 for the blocks per validated block. Current parameter is %s.\n", optarg);
+          exit(0);
+        }
+      }else{
+        printf("Expecting full, sample[:n] or none for the validation. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      break;
+    case 'M':
+      err = sscanf(optarg, "%lf:%lf", &monitor_interval, &monitor_duration);
+      if(err < 1 || monitor_interval <= 0 || monitor_duration < 0){
+        printf("Expecting interval[:duration], in seconds with the interval greater than 0, for the monitoring mode. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      break;
+    case 'N':
+      if(strcmp(optarg, "node") == 0){
+        scope = whole_node;
+      }else if(strcmp(optarg, "socket") == 0){
+        scope = socket_domain;
+      }else if(strcmp(optarg, "numa") == 0){
+        scope = numa_domain;
+      }else{
+        printf("Expecting node, socket, or numa for the scope of the node communicators. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      break;
+    case 'H':
+      if(sscanf(optarg, "%lf", &outlier_threshold) != 1 || outlier_threshold <= 0){
+        printf("Expecting z[:file], with the z-score threshold greater than 0, for the health check. Current parameter is %s.\n", optarg);
+        exit(0);
+      }
+      exclusion_file = strchr(optarg, ':');
+      if(exclusion_file == NULL || exclusion_file[1] == '\0'){
+        exclusion_file = DEFAULT_EXCLUSION_FILE;
+      }else{
+        exclusion_file++;
+      }
+      break;
+    case 'C':
+      if(sscanf(optarg, "%d", &max_read_streams) != 1 || max_read_streams < 1 || max_read_streams > MAX_STREAMS){
+        printf("Expecting a numerical parameter between 1 and %d for the most arrays read in the stream count sweep. Current parameter is %s.\n", MAX_STREAMS, optarg);
+        exit(0);
+      }
+      break;
+    default:
+      printf("Usage: %s [-k kernel_list] [-t type_list] [-s points_per_doubling] [-n local|interleave|matrix|domain] [-g uniform|blocked[:block]] [-d stride] [-l latency_kib] [-p] [-m 4k|thp|2m|1g|hugetlbfs[:mount]] [-a alignment] [-o offset] [-O max_offset[:step]] [-c reads[:writes]] [-C max_reads] [-P] [-w warmup] [-A percent[:seconds]] [-M interval[:duration]] [-L generators[:percent,...]] [-V full|sample[:n]|none] [-N node|socket|numa] [-H z[:file]] cache_size|auto repeats [pmem_path]\n", argv[0]);
+      exit(0);
+    }
+  }
+  // Shift the positional parameters so they start at argv[1] whether or not flags were given
+  argv = argv + optind - 1;
+  num_args = argc - optind + 1;
 
-  if(argc < 3){
+  if(num_args < 3){
     printf("Expecting parameters specifying the size of the last level cache and the number of times to run each benchmark to be provided at runtime.\n");
     exit(0);
   }else{
-    err = sscanf(argv[1], "%zu", &cache_size);
-    if(err != 1 || cache_size < 1){
-      printf("Expecting a numerical parameter greater than 0 for the last level cache size. Current parameter is %ll.\n", cache_size);
-      exit(0);
+    // A cache size of auto means the last level cache size is detected on each node
+    if(strcmp(argv[1], "auto") != 0){
+      err = sscanf(argv[1], "%zu", &cache_size);
+      if(err != 1 || cache_size < 1){
+        printf("Expecting a numerical parameter greater than 0, or auto, for the last level cache size. Current parameter is %s.\n", argv[1]);
+        exit(0);
+      }
     }
     repeats = atoi(argv[2]);
     if(repeats < 0){
@@ -52,12 +355,12 @@ int main(int argc, char **argv){
   } 
 
 #if defined(PMEM) || defined(MEMKIND)
-  if(argc != 4){
+  if(num_args != 4){
     printf("As well as the parameters specifying the size of the last level of cache and the number of times to run each benchmark I am expecting a parameter specifying the path to the persistent memory to be used.\n");
 
     exit(0);
   }else{
-    pmem_path = malloc(strlen(argv[0])*sizeof(char));
+    pmem_path = malloc((strlen(argv[3])+1)*sizeof(char));
     strcpy(pmem_path, argv[3]);
   }
 #endif
@@ -69,14 +372,16 @@ int main(int argc, char **argv){
   world_comm.rank = temp_rank;
   world_comm.size = temp_size;
 
-  // Get a integer key for this process that is different for every node
-  // a process is run on.
-  node_key = get_key();
+  if(settings.persistent_team && thread_support < MPI_THREAD_FUNNELED){
+    if(world_comm.rank == ROOT){
+      printf("The MPI library does not support MPI calls from the master thread of a parallel region (MPI_THREAD_FUNNELED), so the kernels will each use their own parallel region.\n");
+    }
+    settings.persistent_team = 0;
+  }
 
-  // Use the node key to split the MPI_COMM_WORLD communicator
-  // to produce a communicator per node, containing all the processes
-  // running on a given node.
-  MPI_Comm_split(world_comm.comm, node_key, 0, &temp_comm);
+  // Produce a communicator per node, containing all the processes running on a given node
+  // (or on a given socket or NUMA domain of the node, depending on the scope).
+  temp_comm = get_node_comm(scope);
 
   // Get the rank and size of the node communicator this process is involved
   // in.
@@ -100,26 +405,197 @@ int main(int argc, char **argv){
   root_comm.comm = temp_comm;
   root_comm.rank = temp_rank;
   root_comm.size = temp_size;
-	
-  all_node_results = malloc(root_comm.size * sizeof(struct benchmark_results));
 
-  get_processor_and_core(&socket, &core);
+  // The per node results are gathered from the first process of each node in groups of nodes
+  if(node_comm.rank == ROOT){
+    setup_node_groups(root_comm);
+  }
+  check_node_names(world_comm, node_comm, root_comm);
+
+  // The interference task needs at least one process on every node to measure the kernels
+  if(load_generators > 0){
+    MPI_Allreduce(&node_comm.size, &min_node_size, 1, MPI_INT, MPI_MIN, world_comm.comm);
+    if(load_generators >= min_node_size){
+      if(world_comm.rank == ROOT){
+        printf("Running %d traffic generator(s) per node needs more than %d processes on every node, but a node has %d, so the interference task will not be run.\n", load_generators, load_generators, min_node_size);
+      }
+      load_generators = 0;
+    }
+  }
 
-  initialise_benchmark_results(&b_results, repeats);
+  // Detect the size of the last level cache of each node if it was not given on the command
+  // line. Only the first process on a node reads it, and shares it with the rest of the node,
+  // so all the processes on a node size their arrays the same way. Different nodes can end up
+  // with different array sizes if their caches (or numbers of processes) differ.
+  if(cache_size == 0){
+    if(node_comm.rank == ROOT){
+      llc_size = get_llc_size();
+    }
+    MPI_Bcast(&llc_size, 1, MPI_UNSIGNED_LONG_LONG, ROOT, node_comm.comm);
+    MPI_Allreduce(&llc_size, &min_llc_size, 1, MPI_UNSIGNED_LONG_LONG, MPI_MIN, world_comm.comm);
+    MPI_Allreduce(&llc_size, &max_llc_size, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, world_comm.comm);
+    if(min_llc_size == 0){
+      if(world_comm.rank == ROOT){
+        printf("Unable to detect the last level cache size on all the nodes, please provide it on the command line.\n");
+      }
+      MPI_Finalize();
+      exit(0);
+    }
+    if(world_comm.rank == ROOT){
+      printf("Detected last level cache of %.1f MiB to %.1f MiB per node.\n", min_llc_size/1024.0/1024.0, max_llc_size/1024.0/1024.0);
+    }
+    // The cache size is used in elements of the default type
+    cache_size = llc_size/sizeof(STREAM_TYPE);
+  }
+
+  // Report the worst timer of any process, as that limits the accuracy of the results
+  init_timer();
+  timer_values[0] = timer_resolution();
+  timer_values[1] = timer_overhead();
+  MPI_Reduce(timer_values, max_timer_values, 2, MPI_DOUBLE, MPI_MAX, ROOT, world_comm.comm);
+  if(world_comm.rank == ROOT){
+    printf("Timing with %s, resolution %.1f ns, overhead %.1f ns per call.\n", timer_name(), 1.0E9*max_timer_values[0], 1.0E9*max_timer_values[1]);
+  }
 
-  stream_memory_task(&b_results, world_comm, node_comm, &array_size, cache_size, repeats);
-  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, repeats);
+  // Only the root holds the results of every node
+  all_node_results = NULL;
   if(world_comm.rank == ROOT){
-    print_results(a_results, node_results, world_comm, array_size, node_comm);
+    all_node_results = initialise_node_results(root_comm.size);
+    initialise_outlier_results(&outliers, root_comm.size, outlier_threshold);
+  }
+  initialise_aggregate_results(&a_results);
+  initialise_aggregate_results(&node_results);
+  initialise_aggregate_results(&regular_node_results);
+
+  get_processor_and_core(&socket, &core);
+
 #pragma omp parallel default(shared)
   {
     omp_threads = omp_get_num_threads();
   }
-    sprintf(filename, "memory_results-%dx%d-%s.dat", node_comm.size, omp_threads, timestamp); 
-    save_results(filename, all_node_results, array_size, world_comm, node_comm, root_comm);
+
+  // Run the main memory task for each of the selected element types
+  for(type=0; type<num_data_types; type++){
+    if(!data_types[type].enabled){
+      continue;
+    }
+
+    array_size = memory_task_array_size(cache_size, &data_types[type], node_comm);
+    settings.type = &data_types[type];
+    settings.verbose = 1;
+
+    // In matrix mode every CPU domain to memory domain pair on each node is measured, in
+    // place of the fixed size runs below.
+    if(matrix){
+      sprintf(filename, "numa_matrix-%s-%dx%d-%s.dat", data_types[type].name, node_comm.size, omp_threads, timestamp);
+      numa_matrix(filename, settings, cache_size, repeats, world_comm, node_comm, root_comm);
+      continue;
+    }
+
+    // In monitoring mode the memory task is run repeatedly, in place of the fixed size runs below
+    if(monitor_interval > 0){
+      sprintf(filename, "monitor_results-%s-%dx%d-%s.dat", data_types[type].name, node_comm.size, omp_threads, timestamp);
+      memory_monitor(filename, settings, array_size, monitor_interval, monitor_duration, repeats, world_comm, node_comm, root_comm);
+      continue;
+    }
+
+    // In interference mode the kernels are measured against paced background traffic instead
+    if(load_generators > 0){
+      i_results.bandwidths = calloc((size_t)i_results.num_points * num_kernels, sizeof(double));
+      stream_interference_task(&i_results, world_comm, node_comm, array_size, settings, load_generators, repeats);
+      // Only the root holds the results of every node
+      all_node_interference = NULL;
+      if(world_comm.rank == ROOT){
+        all_node_interference = malloc(root_comm.size * sizeof(interference_results));
+      }
+      collect_interference_results(i_results, all_node_interference, node_comm, root_comm);
+      if(world_comm.rank == ROOT){
+        print_interference_results(all_node_interference, load_generators, node_comm, root_comm);
+        sprintf(filename, "interference_results-%s-%dx%d-%s.dat", data_types[type].name, node_comm.size, omp_threads, timestamp);
+        save_interference_results(filename, all_node_interference, load_generators, array_size, &data_types[type], node_comm, root_comm);
+        free(all_node_interference[0].bandwidths);
+        free(all_node_interference);
+      }
+      free(i_results.bandwidths);
+      continue;
+    }
+
+    // In sweep mode the array size is stepped up to the normal array size, in place of
+    // the fixed size runs below.
+    if(sweep_points > 0){
+      sprintf(filename, "sweep_memory_results-%s-%dx%d-%s.dat", data_types[type].name, node_comm.size, omp_threads, timestamp);
+      memory_sweep(filename, settings, array_size, sweep_points, repeats, all_node_results, world_comm, node_comm, root_comm);
+      continue;
+    }
+
+    // In stream count sweep mode the number of arrays read by the Streams kernel is stepped up instead
+    if(max_read_streams > 0){
+      sprintf(filename, "stream_count_results-%s-%dx%d-%s.dat", data_types[type].name, node_comm.size, omp_threads, timestamp);
+      stream_count_sweep(filename, settings, array_size, max_read_streams, repeats, all_node_results, world_comm, node_comm, root_comm);
+      continue;
+    }
+
+    // In offset sweep mode the offset between the arrays is stepped up instead
+    if(offset_sweep){
+      sprintf(filename, "offset_memory_results-%s-%dx%d-%s.dat", data_types[type].name, node_comm.size, omp_threads, timestamp);
+      memory_offset_sweep(filename, settings, array_size, max_offset, offset_step, repeats, all_node_results, world_comm, node_comm, root_comm);
+      continue;
+    }
+
+    initialise_benchmark_results(&b_results, repeats);
+
+    settings.store = regular_stores;
+    stream_memory_task(&b_results, world_comm, node_comm, array_size, settings, repeats);
+    collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
+    check_thread_placement(b_results, world_comm, node_comm, root_comm);
+    if(world_comm.rank == ROOT){
+      print_results(a_results, node_results, world_comm, array_size, data_types[type].size, node_comm);
+      print_numa_placement(all_node_results, root_comm);
+      print_page_coverage(all_node_results, root_comm);
+      sprintf(filename, "memory_results-%s-%dx%d-%s.dat", data_types[type].name, node_comm.size, omp_threads, timestamp);
+      save_results(filename, all_node_results, array_size, &data_types[type], world_comm, node_comm, root_comm);
+      find_memory_outliers(&outliers, all_node_results, "memory", data_types[type].name);
+    }
+
+    free_benchmark_results(&b_results);
+
+    // Run the same kernels again using streaming (non-temporal) stores, so the cost of the
+    // write allocate traffic generated by regular stores can be seen.
+    memcpy(regular_node_results.results, node_results.results, num_kernels * sizeof(struct performance_result));
+
+    initialise_benchmark_results(&b_results, repeats);
+
+    settings.store = streaming_stores;
+    stream_memory_task(&b_results, world_comm, node_comm, array_size, settings, repeats);
+    collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
+    if(world_comm.rank == ROOT){
+      print_results(a_results, node_results, world_comm, array_size, data_types[type].size, node_comm);
+      print_store_comparison(regular_node_results, node_results, array_size, data_types[type].size, node_comm);
+      sprintf(filename, "streaming_memory_results-%s-%dx%d-%s.dat", data_types[type].name, node_comm.size, omp_threads, timestamp);
+      save_results(filename, all_node_results, array_size, &data_types[type], world_comm, node_comm, root_comm);
+      find_memory_outliers(&outliers, all_node_results, "streaming memory", data_types[type].name);
+    }
+
+    free_benchmark_results(&b_results);
   }
 
-  free_benchmark_results(&b_results);
+  // The latency task uses the default element type for the Triad kernel that loads the node
+  if(latency_footprint > 0){
+    array_size = memory_task_array_size(cache_size, &data_types[STREAM_DATA_TYPE], node_comm);
+    all_node_latencies = NULL;
+    if(world_comm.rank == ROOT){
+      all_node_latencies = malloc(root_comm.size * sizeof(latency_results));
+    }
+    stream_latency_task(&l_results, world_comm, node_comm, latency_footprint, array_size, repeats);
+    collect_latency_results(l_results, all_node_latencies, node_comm, root_comm);
+    if(world_comm.rank == ROOT){
+      print_latency_results(all_node_latencies, latency_footprint, node_comm, root_comm);
+      sprintf(filename, "latency_results-%dx%d-%s.dat", node_comm.size, omp_threads, timestamp);
+      save_latency_results(filename, all_node_latencies, latency_footprint, node_comm, root_comm);
+      find_latency_outliers(&outliers, all_node_latencies, node_comm);
+      free(all_node_latencies);
+    }
+  }
 
 
 #ifdef MEMKIND
@@ -131,13 +607,14 @@ int main(int argc, char **argv){
   // processes removing or adding files (as in the persistent memory benchmarks) from
   // previous runs of the program.
   MPI_Barrier(world_comm.comm);
-  stream_memkind_memory_task(&b_results, world_comm, node_comm, &array_size, socket, cache_size, repeats, pmem_path);
-  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, repeats);
+  stream_memkind_memory_task(&b_results, world_comm, node_comm, &array_size, socket, cache_size, repeats, pmem_path, settings.validation);
+  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
   
   if(world_comm.rank == ROOT){
-    print_results(a_results, node_results, world_comm, array_size, node_comm);
+    print_results(a_results, node_results, world_comm, array_size, sizeof(STREAM_TYPE), node_comm);
     sprintf(filename, "memkind_results-%dx%d-%s.dat", node_comm.size, omp_threads, timestamp);
-    save_results(filename, all_node_results, array_size, world_comm, node_comm, root_comm);
+    save_results(filename, all_node_results, array_size, &data_types[STREAM_DATA_TYPE], world_comm, node_comm, root_comm);
+    find_memory_outliers(&outliers, all_node_results, "memkind", NULL);
   }
   
   free_benchmark_results(&b_results);
@@ -154,13 +631,14 @@ int main(int argc, char **argv){
   // previous runs of the program.
   MPI_Barrier(world_comm.comm);
   
-  stream_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, none, cache_size, repeats, pmem_path);
-  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, repeats);
+  stream_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, none, cache_size, repeats, pmem_path, settings.validation);
+  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
   
   if(world_comm.rank == ROOT){
-    print_results(a_results, node_results, world_comm, array_size, node_comm);
+    print_results(a_results, node_results, world_comm, array_size, sizeof(STREAM_TYPE), node_comm);
     sprintf(filename, "persistent_memory_results-%dx%d-%s.dat", node_comm.size, omp_threads, timestamp);
-    save_results(filename, all_node_results, array_size, world_comm, node_comm, root_comm);
+    save_results(filename, all_node_results, array_size, &data_types[STREAM_DATA_TYPE], world_comm, node_comm, root_comm);
+    find_memory_outliers(&outliers, all_node_results, "persistent memory", NULL);
   }
   
   free_benchmark_results(&b_results);
@@ -174,13 +652,14 @@ int main(int argc, char **argv){
   // previous runs of the program.
   MPI_Barrier(world_comm.comm);
   
-  stream_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, individual, cache_size, repeats, pmem_path);
-  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, repeats);
+  stream_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, individual, cache_size, repeats, pmem_path, settings.validation);
+  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
   
   if(world_comm.rank == ROOT){
-    print_results(a_results, node_results, world_comm, array_size, node_comm);
+    print_results(a_results, node_results, world_comm, array_size, sizeof(STREAM_TYPE), node_comm);
     sprintf(filename, "individual_persistent_memory_results-%dx%d-%s.dat", node_comm.size, omp_threads, timestamp);
-    save_results(filename, all_node_results, array_size, world_comm, node_comm, root_comm);
+    save_results(filename, all_node_results, array_size, &data_types[STREAM_DATA_TYPE], world_comm, node_comm, root_comm);
+    find_memory_outliers(&outliers, all_node_results, "individual persistent memory", NULL);
   }
   
   free_benchmark_results(&b_results);
@@ -194,13 +673,14 @@ int main(int argc, char **argv){
   // previous runs of the program.
   MPI_Barrier(world_comm.comm);
   
-  stream_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, collective, cache_size, repeats, pmem_path);
-  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, repeats);
+  stream_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, collective, cache_size, repeats, pmem_path, settings.validation);
+  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
   
   if(world_comm.rank == ROOT){
-    print_results(a_results, node_results, world_comm, array_size, node_comm);
+    print_results(a_results, node_results, world_comm, array_size, sizeof(STREAM_TYPE), node_comm);
     sprintf(filename, "collective_persistent_memory_results-%dx%d-%s.dat", node_comm.size, omp_threads, timestamp);
-    save_results(filename, all_node_results, array_size, world_comm, node_comm, root_comm);
+    save_results(filename, all_node_results, array_size, &data_types[STREAM_DATA_TYPE], world_comm, node_comm, root_comm);
+    find_memory_outliers(&outliers, all_node_results, "collective persistent memory", NULL);
   }
   
   free_benchmark_results(&b_results);
@@ -214,13 +694,14 @@ int main(int argc, char **argv){
   // previous runs of the program.
   MPI_Barrier(world_comm.comm);
 
-  stream_read_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, cache_size, repeats, pmem_path);
-  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, repeats);
+  stream_read_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, cache_size, repeats, pmem_path, settings.validation);
+  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
 
   if(world_comm.rank == ROOT){
-    print_results(a_results, node_results, world_comm, array_size, node_comm);
+    print_results(a_results, node_results, world_comm, array_size, sizeof(STREAM_TYPE), node_comm);
     sprintf(filename, "read_persistent_memory_results-%dx%d-%s.dat", node_comm.size, omp_threads, timestamp);
-    save_results(filename, all_node_results, array_size, world_comm, node_comm, root_comm);
+    save_results(filename, all_node_results, array_size, &data_types[STREAM_DATA_TYPE], world_comm, node_comm, root_comm);
+    find_memory_outliers(&outliers, all_node_results, "read persistent memory", NULL);
   }
 
   free_benchmark_results(&b_results);
@@ -234,13 +715,14 @@ int main(int argc, char **argv){
   // previous runs of the program.
   MPI_Barrier(world_comm.comm);
   
-  stream_write_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, none, cache_size, repeats, pmem_path);
-  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, repeats);
+  stream_write_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, none, cache_size, repeats, pmem_path, settings.validation);
+  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
 
   if(world_comm.rank == ROOT){
-    print_results(a_results, node_results, world_comm, array_size, node_comm);
+    print_results(a_results, node_results, world_comm, array_size, sizeof(STREAM_TYPE), node_comm);
     sprintf(filename, "write_persistent_memory_results-%dx%d-%s.dat", node_comm.size, omp_threads, timestamp);
-    save_results(filename, all_node_results, array_size, world_comm, node_comm, root_comm);
+    save_results(filename, all_node_results, array_size, &data_types[STREAM_DATA_TYPE], world_comm, node_comm, root_comm);
+    find_memory_outliers(&outliers, all_node_results, "write persistent memory", NULL);
   }
 
   free_benchmark_results(&b_results);
@@ -254,13 +736,14 @@ int main(int argc, char **argv){
   // previous runs of the program.
   MPI_Barrier(world_comm.comm);
   
-  stream_write_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, individual, cache_size, repeats, pmem_path);
-  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, repeats);
+  stream_write_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, individual, cache_size, repeats, pmem_path, settings.validation);
+  collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
   
   if(world_comm.rank == ROOT){
-    print_results(a_results, node_results, world_comm, array_size, node_comm);
+    print_results(a_results, node_results, world_comm, array_size, sizeof(STREAM_TYPE), node_comm);
     sprintf(filename, "individual_write_persistent_memory_results-%dx%d-%s.dat", node_comm.size, omp_threads, timestamp);
-    save_results(filename, all_node_results, array_size, world_comm, node_comm, root_comm);
+    save_results(filename, all_node_results, array_size, &data_types[STREAM_DATA_TYPE], world_comm, node_comm, root_comm);
+    find_memory_outliers(&outliers, all_node_results, "individual write persistent memory", NULL);
   }
   
   free_benchmark_results(&b_results);
@@ -274,349 +757,2263 @@ int main(int argc, char **argv){
   // previous runs of the program.
   MPI_Barrier(world_comm.comm);
   
-  stream_write_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, collective, cache_size, repeats, pmem_path);
-  collect_results(b_results, &a_results, &node_results, all_node_results,  world_comm, node_comm, root_comm, repeats);
+  stream_write_persistent_memory_task(&b_results, world_comm, node_comm, &array_size, socket, collective, cache_size, repeats, pmem_path, settings.validation);
+  collect_results(b_results, &a_results, &node_results, all_node_results,  world_comm, node_comm, root_comm, b_results.repeats);
   
   if(world_comm.rank == ROOT){
-    print_results(a_results, node_results, world_comm, array_size, node_comm);
+    print_results(a_results, node_results, world_comm, array_size, sizeof(STREAM_TYPE), node_comm);
     sprintf(filename, "collective_individual_write_persistent_memory_results-%dx%d-%s.dat", node_comm.size, omp_threads, timestamp);
-    save_results(filename, all_node_results, array_size, world_comm, node_comm, root_comm);
+    save_results(filename, all_node_results, array_size, &data_types[STREAM_DATA_TYPE], world_comm, node_comm, root_comm);
+    find_memory_outliers(&outliers, all_node_results, "collective individual write persistent memory", NULL);
   }
   
   free_benchmark_results(&b_results);
 #endif
+
+  // Report the nodes that stood out from the rest in any of the tasks run, and share how many
+  // there were so every process can exit with the same code for a health check
+  if(world_comm.rank == ROOT){
+    num_flagged = report_outliers(&outliers, exclusion_file);
+  }
+  MPI_Bcast(&num_flagged, 1, MPI_INT, ROOT, world_comm.comm);
   
+  if(node_comm.rank == ROOT){
+    free_node_groups();
+  }
   MPI_Finalize();
 
-  free(all_node_results);
+  if(world_comm.rank == ROOT){
+    free_node_results(all_node_results);
+    free_outlier_results(&outliers);
+  }
+  free_aggregate_results(&a_results);
+  free_aggregate_results(&node_results);
+  free_aggregate_results(&regular_node_results);
   free(filename);
 
 #if defined(PMEM) || defined(MEMKIND)
   free(pmem_path);
 #endif
 
+  if(exclusion_file != NULL && num_flagged > 0){
+    return EXIT_FAILURE;
+  }
+
   return 0;
 
 }
 
-void collect_results(benchmark_results b_results, aggregate_results *a_results, aggregate_results *node_results, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm, int repeats){
+// The smallest array size used by a sweep, small enough for all three arrays of every
+// process to be resident in the L1 cache.
+#define MIN_SWEEP_BYTES 1024
 
-  benchmark_type benchmark;
+// The fraction of the peak bandwidth the stream count sweep reports the bandwidth falling below
+#define STREAM_COUNT_FALL_OFF 0.9
 
-  benchmark = copy;
-  collect_individual_result(b_results.Copy, &a_results->Copy, &node_results->Copy, a_results->copy_max, b_results.name, all_node_results, benchmark, world_comm, node_comm, root_comm, repeats);
-  benchmark = scale;
-  collect_individual_result(b_results.Scale, &a_results->Scale, &node_results->Scale, a_results->scale_max,  b_results.name, all_node_results, benchmark, world_comm, node_comm, root_comm, repeats);
-  benchmark = add;
-  collect_individual_result(b_results.Add, &a_results->Add, &node_results->Add, a_results->add_max, b_results.name, all_node_results, benchmark, world_comm, node_comm, root_comm, repeats);
-  benchmark = triad;
-  collect_individual_result(b_results.Triad, &a_results->Triad, &node_results->Triad, a_results->triad_max, b_results.name, all_node_results, benchmark, world_comm, node_comm, root_comm, repeats);
+// Size the monitoring file can grow to before it is moved aside (to the same name with .1
+// appended, replacing the previous one) and a new file started
+#define MONITOR_FILE_BYTES (64*1024*1024)
 
-}
+// Run the main memory task over a geometric sequence of array sizes, from L1 resident
+// up to max_array_size, with points_per_doubling sizes for every doubling of the array
+// size. The per node results for each size are kept by the root process and saved as a
+// bandwidth against size curve for each node.
+void memory_sweep(char *filename, task_settings settings, size_t max_array_size, int points_per_doubling, int repeats, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm){
 
-void collect_individual_result(performance_result indivi, performance_result *result, performance_result *node_result, char *max_name, char *name, benchmark_results *all_node_results, benchmark_type benchmark, communicator world_comm, communicator node_comm, communicator root_comm, int repeats){
+  benchmark_results b_results;
+  aggregate_results a_results;
+  aggregate_results node_results;
+  benchmark_results **sweep_node_results = NULL;
+  size_t *sweep_sizes;
+  size_t min_array_size;
+  unsigned long long largest_array_size;
+  data_type *type = settings.type;
+  double factor, size;
+  int num_points, point, i;
+
+  // All the processes have to run the same sequence of sizes, so use the largest array size
+  // of any process (they can differ between nodes) as the end of the sweep.
+  largest_array_size = max_array_size;
+  MPI_Allreduce(MPI_IN_PLACE, &largest_array_size, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, world_comm.comm);
+  max_array_size = largest_array_size;
+  min_array_size = MAX(MIN_SWEEP_BYTES/type->size, 1);
+  max_array_size = MAX(max_array_size, min_array_size);
+  factor = pow(2.0, 1.0/points_per_doubling);
+  num_points = (int)ceil(log2((double)max_array_size/min_array_size)*points_per_doubling) + 1;
+
+  // Steps that round to the same number of elements are only run once, so the
+  // sequence of sizes is worked out before anything is run.
+  sweep_sizes = malloc(num_points * sizeof(size_t));
+  size = min_array_size;
+  point = 0;
+  for(i=0; i<num_points; i++){
+    if(point == 0 || (size_t)size > sweep_sizes[point-1]){
+      sweep_sizes[point] = MIN((size_t)size, max_array_size);
+      point++;
+    }
+    size = size*factor;
+  }
+  if(sweep_sizes[point-1] != max_array_size){
+    sweep_sizes[point-1] = max_array_size;
+  }
+  num_points = point;
 
-  // Structure to hold both a value and a rank for MAXLOC and MINLOC operations.
-  // This *may* be problematic on some MPI implementations as it assume MPI_DOUBLE_INT
-  // matches this specification.
-  typedef struct resultloc {
-    double value;
-    int   rank;
-  } resultloc;
+  initialise_aggregate_results(&a_results);
+  initialise_aggregate_results(&node_results);
+  if(world_comm.rank == ROOT){
+    sweep_node_results = malloc(num_points * sizeof(benchmark_results *));
+    printf("Stream Memory Sweep\n");
+    printf("Array elements are %s, sweeping %d array sizes from %zu to %zu elements per process.\n", type->name, num_points, sweep_sizes[0], sweep_sizes[num_points-1]);
+    printf("Array Size   Memory per process");
+    for(i=0; i<num_kernels; i++){
+      if(kernel_registry[i].enabled){
+        printf("   Node %-8s", kernel_registry[i].name);
+      }
+    }
+    printf("\n");
+    printf("(elements)   (KiB)             ");
+    for(i=0; i<num_kernels; i++){
+      if(kernel_registry[i].enabled){
+        printf("   (MB/s)       ");
+      }
+    }
+    printf("\n");
+  }
 
-  double temp_value;
-  double temp_result;
+  settings.store = regular_stores;
+  settings.verbose = 0;
+
+  for(point=0; point<num_points; point++){
+    initialise_benchmark_results(&b_results, repeats);
+    stream_memory_task(&b_results, world_comm, node_comm, sweep_sizes[point], settings, repeats);
+    // Only the root process keeps the node results for every point of the sweep
+    if(world_comm.rank == ROOT){
+      sweep_node_results[point] = initialise_node_results(root_comm.size);
+      collect_results(b_results, &a_results, &node_results, sweep_node_results[point], world_comm, node_comm, root_comm, b_results.repeats);
+      printf("%-12zu %-18.1f", sweep_sizes[point], 3.0*type->size*sweep_sizes[point]/1024.0);
+      for(i=0; i<num_kernels; i++){
+        if(node_results.results[i].used){
+          size = (double)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * type->size * sweep_sizes[point] * node_comm.size;
+          printf("   %12.1f   ", (1.0E-06 * size)/node_results.results[i].avg);
+        }
+      }
+      printf("\n");
+    }else{
+      collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
+    }
+    free_benchmark_results(&b_results);
+  }
 
-  double temp_store, min_time_store, max_time_store;
+  if(world_comm.rank == ROOT){
+    save_sweep_results(filename, sweep_node_results, sweep_sizes, NULL, num_points, type, world_comm, node_comm, root_comm);
+    for(point=0; point<num_points; point++){
+      free_node_results(sweep_node_results[point]);
+    }
+    free(sweep_node_results);
+  }
 
-  int k;
+  free_aggregate_results(&a_results);
+  free_aggregate_results(&node_results);
+  free(sweep_sizes);
 
-  double max_for_nodes[root_comm.size];
-  double min_for_nodes[root_comm.size];
-  double average_for_nodes[root_comm.size];
-  char node_names[root_comm.size][MPI_MAX_PROCESSOR_NAME];
+}
 
-  // Variable for the result of the reduction
-  resultloc rloc;
-  // Variable for the data to be reduced
-  resultloc iloc;
+// Run the main memory task with the offset between the arrays stepped from 0 up to
+// max_offset elements, keeping the array size fixed. As each array starts the offset
+// further from an alignment boundary than the one before, this moves the same element
+// of each array between cache sets, and DRAM banks and channels, showing up any
+// offsets that conflict. The arrays are aligned to a page if no alignment was given, so
+// the offset is the only thing that changes between points.
+void memory_offset_sweep(char *filename, task_settings settings, size_t array_size, size_t max_offset, size_t offset_step, int repeats, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm){
 
-  int root = ROOT;
-  MPI_Status status;
+  benchmark_results b_results;
+  aggregate_results a_results;
+  aggregate_results node_results;
+  benchmark_results **sweep_node_results = NULL;
+  size_t *sweep_sizes, *sweep_offsets;
+  unsigned long long largest_array_size;
+  double *bandwidths = NULL;
+  data_type *type = settings.type;
+  double size, best, worst;
+  int num_points, point, best_point, worst_point, i;
+
+  // As in memory_sweep all the processes use the largest array size of any process
+  largest_array_size = array_size;
+  MPI_Allreduce(MPI_IN_PLACE, &largest_array_size, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, world_comm.comm);
+  array_size = largest_array_size;
+
+  num_points = max_offset/offset_step + 1;
+  sweep_sizes = malloc(num_points * sizeof(size_t));
+  sweep_offsets = malloc(num_points * sizeof(size_t));
+  for(point=0; point<num_points; point++){
+    sweep_sizes[point] = array_size;
+    sweep_offsets[point] = point*offset_step;
+  }
 
-  MPI_Reduce(&indivi.avg, &result->avg, 1, MPI_DOUBLE, MPI_SUM, root, world_comm.comm);
-  if(world_comm.rank == root){
-    result->avg = result->avg/world_comm.size;
+  if(settings.alignment == 0){
+    settings.alignment = sysconf(_SC_PAGESIZE);
   }
 
-  // Get the total avg value summed across all processes in a node to enable calculation
-  // of the avg bandwidth for a node.
-  temp_store = 0;
-  for(k=1; k<repeats; k++) {
-    temp_value = indivi.raw_result[k];
-    MPI_Reduce(&temp_value, &temp_result, 1, MPI_DOUBLE, MPI_SUM, root, node_comm.comm);
-    temp_result = temp_result/node_comm.size;
-    temp_store = temp_store + temp_result;
+  initialise_aggregate_results(&a_results);
+  initialise_aggregate_results(&node_results);
+  if(world_comm.rank == ROOT){
+    sweep_node_results = malloc(num_points * sizeof(benchmark_results *));
+    bandwidths = calloc((size_t)num_points * num_kernels, sizeof(double));
+    printf("Stream Memory Offset Sweep\n");
+    printf("Array elements are %s, %zu elements per process, aligned to %zu bytes, sweeping %d offsets from 0 to %zu elements.\n", type->name, array_size, settings.alignment, num_points, sweep_offsets[num_points-1]);
+    printf("Offset       Offset            ");
+    for(i=0; i<num_kernels; i++){
+      if(kernel_registry[i].enabled){
+        printf("   Node %-8s", kernel_registry[i].name);
+      }
+    }
+    printf("\n");
+    printf("(elements)   (bytes)           ");
+    for(i=0; i<num_kernels; i++){
+      if(kernel_registry[i].enabled){
+        printf("   (MB/s)       ");
+      }
+    }
+    printf("\n");
   }
-  temp_store = temp_store/(repeats-1);
-  node_result->avg = temp_store;
 
+  settings.store = regular_stores;
+  settings.verbose = 0;
+
+  for(point=0; point<num_points; point++){
+    settings.offset = sweep_offsets[point];
+    initialise_benchmark_results(&b_results, repeats);
+    stream_memory_task(&b_results, world_comm, node_comm, array_size, settings, repeats);
+    // As in memory_sweep only the root process keeps the node results for every point
+    if(world_comm.rank == ROOT){
+      sweep_node_results[point] = initialise_node_results(root_comm.size);
+      collect_results(b_results, &a_results, &node_results, sweep_node_results[point], world_comm, node_comm, root_comm, b_results.repeats);
+      printf("%-12zu %-18zu", sweep_offsets[point], sweep_offsets[point]*type->size);
+      for(i=0; i<num_kernels; i++){
+        if(node_results.results[i].used){
+          size = (double)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * type->size * array_size * node_comm.size;
+          bandwidths[point*num_kernels + i] = (1.0E-06 * size)/node_results.results[i].avg;
+          printf("   %12.1f   ", bandwidths[point*num_kernels + i]);
+        }
+      }
+      printf("\n");
+    }else{
+      collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
+    }
+    free_benchmark_results(&b_results);
+  }
 
-  if(node_comm.rank == root){
-    temp_value = node_result->avg;
-    MPI_Reduce(&temp_value, &temp_result, 1, MPI_DOUBLE, MPI_SUM, root, root_comm.comm);
-    if(world_comm.rank == root){
-      node_result->avg = temp_result/root_comm.size;
+  if(world_comm.rank == ROOT){
+    // The offsets to avoid are the ones well below the best
+    for(i=0; i<num_kernels; i++){
+      if(!kernel_registry[i].enabled){
+        continue;
+      }
+      best_point = 0;
+      worst_point = 0;
+      for(point=1; point<num_points; point++){
+        if(bandwidths[point*num_kernels + i] > bandwidths[best_point*num_kernels + i]){
+          best_point = point;
+        }
+        if(bandwidths[point*num_kernels + i] < bandwidths[worst_point*num_kernels + i]){
+          worst_point = point;
+        }
+      }
+      best = bandwidths[best_point*num_kernels + i];
+      worst = bandwidths[worst_point*num_kernels + i];
+      printf("%s: best offset %zu elements (%.1f MB/s), worst offset %zu elements (%.1f MB/s, %.1f%% of the best)\n", kernel_registry[i].name, sweep_offsets[best_point], best, sweep_offsets[worst_point], worst, 100.0*worst/best);
     }
-    MPI_Gather(&temp_value, 1, MPI_DOUBLE, &average_for_nodes, 1, MPI_DOUBLE, root, root_comm.comm);
-    MPI_Gather(name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, &node_names, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, root, root_comm.comm);
+    save_sweep_results(filename, sweep_node_results, sweep_sizes, sweep_offsets, num_points, type, world_comm, node_comm, root_comm);
+    for(point=0; point<num_points; point++){
+      free_node_results(sweep_node_results[point]);
+    }
+    free(sweep_node_results);
+    free(bandwidths);
   }
 
+  free_aggregate_results(&a_results);
+  free_aggregate_results(&node_results);
+  free(sweep_sizes);
+  free(sweep_offsets);
+
+}
+
+// Run the Streams kernel reading from 1 up to max_reads arrays (and writing the number of
+// arrays set in the settings), keeping the array size fixed. The node bandwidth against
+// the number of arrays being streamed through at once shows where the hardware prefetchers
+// run out of streams they can track, or the memory controllers run out of open pages.
+void stream_count_sweep(char *filename, task_settings settings, size_t array_size, int max_reads, int repeats, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm){
 
-  iloc.value = indivi.max;
-  iloc.rank = world_comm.rank;
-  MPI_Allreduce(&iloc, &rloc, 1, MPI_DOUBLE_INT, MPI_MAXLOC, world_comm.comm);
-  if(rloc.rank == world_comm.rank && rloc.value != indivi.max){
-    printf("Error with the output of MPI_MAXLOC reduction");
+  benchmark_results b_results;
+  aggregate_results a_results;
+  aggregate_results node_results;
+  benchmark_results **sweep_node_results = NULL;
+  int *sweep_reads;
+  int enabled[num_kernels];
+  double *bandwidths = NULL;
+  unsigned long long largest_array_size;
+  data_type *type = settings.type;
+  double size;
+  int num_points, point, peak_point, i;
+
+  // As in memory_sweep all the processes use the largest array size of any process
+  largest_array_size = array_size;
+  MPI_Allreduce(MPI_IN_PLACE, &largest_array_size, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, world_comm.comm);
+  array_size = largest_array_size;
+
+  num_points = max_reads;
+  sweep_reads = malloc(num_points * sizeof(int));
+  for(point=0; point<num_points; point++){
+    sweep_reads[point] = point + 1;
+  }
+
+  // Only the Streams kernel is run, the kernel selection is put back afterwards
+  for(i=0; i<num_kernels; i++){
+    enabled[i] = kernel_registry[i].enabled;
+    kernel_registry[i].enabled = (i == streams);
   }
-  result->max = rloc.value;
-  // Communicate which node has the biggest max value so outlier nodes can be identified
-  if(rloc.rank == world_comm.rank && rloc.rank != root){
-    MPI_Ssend(name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, root, 0, world_comm.comm);
-  }else if(world_comm.rank == root && rloc.rank != root){
-    MPI_Recv(max_name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, rloc.rank, 0, world_comm.comm, &status);
-  }else if(world_comm.rank == root && rloc.rank == root){
-    strcpy(max_name, name);
+
+  initialise_aggregate_results(&a_results);
+  initialise_aggregate_results(&node_results);
+  if(world_comm.rank == ROOT){
+    sweep_node_results = malloc(num_points * sizeof(benchmark_results *));
+    bandwidths = calloc(num_points, sizeof(double));
+    printf("Stream Count Sweep\n");
+    printf("Array elements are %s, %zu elements per array per process, reading 1 to %d arrays and writing %d.\n", type->name, array_size, max_reads, settings.write_streams);
+    printf("Arrays read   Arrays written   Node Bandwidth   Per Array\n");
+    printf("                                   (MB/s)         (MB/s)\n");
   }
 
+  settings.store = regular_stores;
+  settings.verbose = 0;
+
+  for(point=0; point<num_points; point++){
+    settings.read_streams = sweep_reads[point];
+    initialise_benchmark_results(&b_results, repeats);
+    stream_memory_task(&b_results, world_comm, node_comm, array_size, settings, repeats);
+    // As in memory_sweep only the root process keeps the node results for every point
+    if(world_comm.rank == ROOT){
+      sweep_node_results[point] = initialise_node_results(root_comm.size);
+      collect_results(b_results, &a_results, &node_results, sweep_node_results[point], world_comm, node_comm, root_comm, b_results.repeats);
+      size = (double)(sweep_reads[point] + settings.write_streams) * type->size * array_size * node_comm.size;
+      bandwidths[point] = (1.0E-06 * size)/node_results.results[streams].avg;
+      printf("%-13d %-16d %14.1f %12.1f\n", sweep_reads[point], settings.write_streams, bandwidths[point], bandwidths[point]/(sweep_reads[point] + settings.write_streams));
+    }else{
+      collect_results(b_results, &a_results, &node_results, all_node_results, world_comm, node_comm, root_comm, b_results.repeats);
+    }
+    free_benchmark_results(&b_results);
+  }
 
-  // Get the total max value across all processes in a node for each repeat of the benchmark to enable calculation
-  // of the minimum and maximum bandwidth seen within a node. The minimum bandwidth will be the longest time 
-  // for all processes across all the repeats of the benchmark (i.e. that represents the maximum runtime for 
-  // any of the repeats). The maximum bandwidth will be the minimum longest time across the repeats of the 
-  // benchmark (i.e. the repeat of the benchmark that takes the shortest overall time). We can use Max here 
-  // because each benchmark is surrounded by Barriers meaning that the longest process for each run 
-  // represents the slowest part of that run and therefore the limit on the bandwith achieved.
-  max_time_store = 0;
-  min_time_store = FLT_MAX;
-  for(k=1; k<repeats; k++) {
-    temp_value = indivi.raw_result[k];
-    MPI_Reduce(&temp_value, &temp_result, 1, MPI_DOUBLE, MPI_MAX, root, node_comm.comm);
-    if(temp_result > max_time_store){
-      max_time_store = temp_result;
+  if(world_comm.rank == ROOT){
+    // The point the hardware runs out of streams is where the bandwidth falls away from its peak
+    peak_point = 0;
+    for(point=1; point<num_points; point++){
+      if(bandwidths[point] > bandwidths[peak_point]){
+        peak_point = point;
+      }
+    }
+    printf("Peak node bandwidth %.1f MB/s with %d arrays read and %d written", bandwidths[peak_point], sweep_reads[peak_point], settings.write_streams);
+    for(point=peak_point+1; point<num_points; point++){
+      if(bandwidths[point] < STREAM_COUNT_FALL_OFF*bandwidths[peak_point]){
+        printf(", falling below %.0f%% of the peak at %d arrays read", 100.0*STREAM_COUNT_FALL_OFF, sweep_reads[point]);
+        break;
+      }
     }
-    if(temp_result < min_time_store){
-      min_time_store = temp_result;
+    printf("\n");
+    save_stream_count_results(filename, sweep_node_results, sweep_reads, num_points, settings.write_streams, type, world_comm, node_comm, root_comm);
+    for(point=0; point<num_points; point++){
+      free_node_results(sweep_node_results[point]);
     }
+    free(sweep_node_results);
+    free(bandwidths);
   }
 
-  node_result->max = max_time_store;
-  node_result->min = min_time_store;
+  for(i=0; i<num_kernels; i++){
+    kernel_registry[i].enabled = enabled[i];
+  }
 
+  free_aggregate_results(&a_results);
+  free_aggregate_results(&node_results);
+  free(sweep_reads);
 
-  // Get the total max and min value across all the nodes
-  // For the max we want the slowest node (i.e. the MPI_MAX of the max)
-  // For the min we want the fastest node (i.e. the MPI_MIN of the min)
-  // These should give us the upper and lower bounds on the node performances
-  if(node_comm.rank == root){
-    temp_value = node_result->max;
-    MPI_Reduce(&temp_value, &temp_result, 1, MPI_DOUBLE, MPI_MAX, root, root_comm.comm);
-    if(world_comm.rank == root){
-      node_result->max = temp_result;
-    }
-    MPI_Gather(&temp_value, 1, MPI_DOUBLE, &max_for_nodes, 1, MPI_DOUBLE, root, root_comm.comm);
-    temp_value = node_result->min;
-    MPI_Reduce(&temp_value, &temp_result, 1, MPI_DOUBLE, MPI_MIN, root, root_comm.comm);
-    if(world_comm.rank == root){
-      node_result->min = temp_result;
-    }
-    MPI_Gather(&temp_value, 1, MPI_DOUBLE, &min_for_nodes, 1, MPI_DOUBLE, root, root_comm.comm);
+}
+
+// Open the monitoring file for appending, starting it with a header if it is empty
+static FILE *open_monitor_file(char *filename){
+
+  FILE *fp;
 
+  fp = fopen(filename, "a");
+  if(fp == NULL){
+    printf("Unable to open the monitoring file %s.\n", filename);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  if(ftell(fp) == 0){
+    fprintf(fp, "# time node kernel bandwidth(MB/s)\n");
   }
 
+  return fp;
 
-  iloc.value = indivi.min;
-  iloc.rank = world_comm.rank;
-  MPI_Allreduce(&iloc, &rloc, 1, MPI_DOUBLE_INT, MPI_MINLOC, world_comm.comm);
-  result->min = rloc.value;
+}
 
+// Run the memory task every interval seconds until duration seconds have passed (or until the
+// job is stopped if duration is zero), appending each node's bandwidth for every kernel to a
+// rolling text file, one line per node and kernel, so the bandwidth of the nodes can be watched
+// over hours. Each sample is the best repeat of the node, as for the node results. Only a fixed
+// number of running statistics are kept for each node and kernel, whatever the number of
+// samples, and these are summarised at the end.
+void memory_monitor(char *filename, task_settings settings, size_t array_size, double interval, double duration, int repeats, communicator world_comm, communicator node_comm, communicator root_comm){
 
-  if(node_comm.rank == root){
-    switch (benchmark){
-    case copy:
-      for(k=0; k<root_comm.size; k++){
-	all_node_results[k].Copy.avg = average_for_nodes[k];
-	all_node_results[k].Copy.max = max_for_nodes[k];
-	all_node_results[k].Copy.min = min_for_nodes[k];
-      }
-      break;
-    case scale:
-      for(k=0; k<root_comm.size; k++){
-	all_node_results[k].Scale.avg = average_for_nodes[k];
-	all_node_results[k].Scale.max = max_for_nodes[k];
-	all_node_results[k].Scale.min = min_for_nodes[k];
+  benchmark_results b_results;
+  data_type *type = settings.type;
+  FILE *fp = NULL;
+  char (*node_names)[MPI_MAX_PROCESSOR_NAME] = NULL;
+  char name[MPI_MAX_PROCESSOR_NAME];
+  char old_filename[MAX_FILE_NAME_LENGTH + 3];
+  char sample_time[25];
+  time_t local_time;
+  struct tm current_time;
+  struct timespec pause;
+  running_stats *stats = NULL;
+  double *lowest = NULL;
+  double node_bandwidths[num_kernels];
+  double best_times[num_kernels];
+  double *all_node_bandwidths = NULL;
+  double start, now, size, mean, spread, lowest_sample, variation, worst;
+  double timing[2];
+  int samples, i, n, worst_node;
+
+  get_node_name(name);
+  if(node_comm.rank == ROOT){
+    if(root_comm.rank == ROOT){
+      node_names = malloc((size_t)root_comm.size * sizeof(*node_names));
+    }
+    gather_nodes(name, MPI_MAX_PROCESSOR_NAME, node_names, root_comm);
+  }
+  if(world_comm.rank == ROOT){
+    all_node_bandwidths = malloc((size_t)root_comm.size * num_kernels * sizeof(double));
+    stats = calloc((size_t)root_comm.size * num_kernels, sizeof(running_stats));
+    lowest = malloc((size_t)root_comm.size * num_kernels * sizeof(double));
+    for(i=0; i<root_comm.size * num_kernels; i++){
+      lowest[i] = FLT_MAX;
+    }
+    fp = open_monitor_file(filename);
+    printf("Monitoring\n");
+    printf("Running the memory task every %.1f seconds", interval);
+    if(duration > 0){
+      printf(" for %.1f seconds", duration);
+    }
+    printf(", appending the bandwidth of every node to %s.\n", filename);
+  }
+
+  settings.store = regular_stores;
+  start = mysecond();
+  samples = 0;
+  timing[1] = 0;
+  while(!timing[1]){
+    // Only the first sample describes the task
+    settings.verbose = (samples == 0);
+    initialise_benchmark_results(&b_results, repeats);
+    stream_memory_task(&b_results, world_comm, node_comm, array_size, settings, repeats);
+    local_time = time(NULL);
+    localtime_r(&local_time, &current_time);
+    strftime(sample_time, 25, "%Y-%m-%dT%H:%M:%S", &current_time);
+
+    // The slowest process limits each repeat, and the best repeat is used
+    node_best_times(&b_results, node_comm, best_times);
+    for(i=0; i<num_kernels; i++){
+      node_bandwidths[i] = 0;
+      if(!b_results.results[i].used){
+        continue;
       }
-      break;
-    case add:
-      for(k=0; k<root_comm.size; k++){
-	all_node_results[k].Add.avg = average_for_nodes[k];
-	all_node_results[k].Add.max = max_for_nodes[k];
-	all_node_results[k].Add.min = min_for_nodes[k];
+      size = (double)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * type->size * b_results.array_size * node_comm.size;
+      node_bandwidths[i] = (1.0E-06 * size)/best_times[i];
+    }
+    if(node_comm.rank == ROOT){
+      gather_nodes(node_bandwidths, num_kernels * sizeof(double), all_node_bandwidths, root_comm);
+    }
+
+    if(world_comm.rank == ROOT){
+      printf("%s", sample_time);
+      for(i=0; i<num_kernels; i++){
+        if(!b_results.results[i].used){
+          continue;
+        }
+        mean = 0;
+        for(n=0; n<root_comm.size; n++){
+          fprintf(fp, "%s %s %s %.1f\n", sample_time, node_names[n], kernel_registry[i].name, all_node_bandwidths[n*num_kernels + i]);
+          running_stats_add(&stats[n*num_kernels + i], all_node_bandwidths[n*num_kernels + i]);
+          lowest[n*num_kernels + i] = MIN(lowest[n*num_kernels + i], all_node_bandwidths[n*num_kernels + i]);
+          mean = mean + all_node_bandwidths[n*num_kernels + i];
+        }
+        printf("  %s %.1f", kernel_registry[i].name, mean/root_comm.size);
       }
-      break;
-    case triad:
-      for(k=0; k<root_comm.size; k++){
-	all_node_results[k].Triad.avg = average_for_nodes[k];
-	all_node_results[k].Triad.max = max_for_nodes[k];
-	all_node_results[k].Triad.min = min_for_nodes[k];
+      printf(" MB/s (node average)\n");
+      fflush(fp);
+      if(ftell(fp) > MONITOR_FILE_BYTES){
+        fclose(fp);
+        sprintf(old_filename, "%s.1", filename);
+        rename(filename, old_filename);
+        fp = open_monitor_file(filename);
       }
-      break;
-    default:
-      break;
     }
-    for(k=0; k<root_comm.size; k++){
-      strcpy(all_node_results[k].name, node_names[k]);
+    free_benchmark_results(&b_results);
+    samples++;
+
+    // The root process decides when the next sample starts, and whether there is one, so all
+    // the processes agree
+    if(world_comm.rank == ROOT){
+      now = mysecond();
+      timing[0] = MAX(start + samples*interval - now, 0);
+      timing[1] = (duration > 0 && now + timing[0] - start >= duration);
+    }
+    MPI_Bcast(timing, 2, MPI_DOUBLE, ROOT, world_comm.comm);
+    if(!timing[1] && timing[0] > 0){
+      pause.tv_sec = (time_t)timing[0];
+      pause.tv_nsec = (long)((timing[0] - pause.tv_sec) * 1.0E9);
+      nanosleep(&pause, NULL);
     }
   }
 
+  if(world_comm.rank == ROOT){
+    fclose(fp);
+    printf("%d samples taken.\n", samples);
+    printf("Kernel           Node Average   Node Std Dev   Lowest Sample   Most Variable Node (std dev/mean)\n");
+    printf("                    (MB/s)         (MB/s)         (MB/s)\n");
+    for(i=0; i<num_kernels; i++){
+      if(stats[i].count == 0){
+        continue;
+      }
+      mean = 0;
+      spread = 0;
+      lowest_sample = FLT_MAX;
+      worst = -1;
+      worst_node = 0;
+      for(n=0; n<root_comm.size; n++){
+        mean = mean + stats[n*num_kernels + i].mean;
+        spread = spread + sqrt(running_stats_variance(&stats[n*num_kernels + i]));
+        lowest_sample = MIN(lowest_sample, lowest[n*num_kernels + i]);
+        variation = sqrt(running_stats_variance(&stats[n*num_kernels + i]))/stats[n*num_kernels + i].mean;
+        if(variation > worst){
+          worst = variation;
+          worst_node = n;
+        }
+      }
+      printf("%-14s %14.1f %14.1f %15.1f   %s (%.3f)\n", kernel_registry[i].name, mean/root_comm.size, spread/root_comm.size, lowest_sample, node_names[worst_node], worst);
+    }
+    free(all_node_bandwidths);
+    free(stats);
+    free(lowest);
+  }
+  free(node_names);
 
 }
 
-// Initialise the benchmark results structure to enable proper collection of data
-void initialise_benchmark_results(benchmark_results *b_results, int repeats){
+// Measure the bandwidth from every CPU domain to every memory domain of each node. The processes
+// are grouped by the NUMA domain they are running on (so they should be bound to cores for this to
+// be meaningful), and for each pair only the processes of the CPU domain run the memory task, with
+// all their arrays placed on the memory domain. This exposes slow links between sockets and badly
+// configured memory that a single figure for the whole node hides.
+void numa_matrix(char *filename, task_settings settings, size_t cache_size, int repeats, communicator world_comm, communicator node_comm, communicator root_comm){
 
-  int name_length;
-
-  b_results->Copy.avg = 0;
-  b_results->Copy.min = FLT_MAX;
-  b_results->Copy.max= 0;
-  b_results->Copy.raw_result = malloc(repeats * sizeof(double));
-  b_results->Scale.avg = 0;
-  b_results->Scale.min = FLT_MAX;
-  b_results->Scale.max= 0;
-  b_results->Scale.raw_result = malloc(repeats * sizeof(double));
-  b_results->Add.avg = 0;
-  b_results->Add.min = FLT_MAX;
-  b_results->Add.max= 0;
-  b_results->Add.raw_result = malloc(repeats * sizeof(double));
-  b_results->Triad.avg = 0;
-  b_results->Triad.min = FLT_MAX;
-  b_results->Triad.max= 0;
-  b_results->Triad.raw_result = malloc(repeats * sizeof(double));
-  MPI_Get_processor_name(b_results->name, &name_length);
-
-}
-
-// Initialise the benchmark results structure to enable proper collection of data
-void free_benchmark_results(benchmark_results *b_results){
+  benchmark_results b_results;
+  data_type *type = settings.type;
+  communicator domain_comm;
+  MPI_Comm temp_comm;
+  size_t array_size;
+  double *matrix, *all_node_matrices = NULL;
+  char (*node_names)[MPI_MAX_PROCESSOR_NAME] = NULL;
+  char name[MPI_MAX_PROCESSOR_NAME];
+  double best_times[num_kernels];
+  double size;
+  int num_domains, cpu_domain, mem_domain, domain;
+  int matrix_size;
+  int i, k;
+
+  // Every node has to use the same matrix layout, so use the most domains found on any node
+  num_domains = MIN(get_num_numa_domains(), MAX_NUMA_DOMAINS);
+  MPI_Allreduce(MPI_IN_PLACE, &num_domains, 1, MPI_INT, MPI_MAX, world_comm.comm);
+  matrix_size = num_kernels * num_domains * num_domains;
+
+  // The domain of the master thread is used for the whole process
+  cpu_domain = get_numa_domain();
+  MPI_Comm_split(node_comm.comm, cpu_domain, node_comm.rank, &temp_comm);
+  domain_comm.comm = temp_comm;
+  MPI_Comm_size(temp_comm, &domain_comm.size);
+  MPI_Comm_rank(temp_comm, &domain_comm.rank);
+
+  // Each domain uses the array size the whole node would, so the arrays still exceed the cache
+  array_size = memory_task_array_size(cache_size, type, domain_comm);
+
+  settings.store = regular_stores;
+  settings.placement = node_placement;
+  settings.verbose = 0;
+
+  if(world_comm.rank == ROOT){
+    printf("Stream NUMA Matrix\n");
+    printf("Array elements are %s, measuring %d CPU domains against %d memory domains per node.\n", type->name, num_domains, num_domains);
+  }
+
+  matrix = calloc(matrix_size, sizeof(double));
+  for(domain=0; domain<num_domains; domain++){
+    for(mem_domain=0; mem_domain<num_domains; mem_domain++){
+      // Keep the whole node in step so only one pair is being measured at a time
+      MPI_Barrier(node_comm.comm);
+      if(cpu_domain != domain || !numa_domain_has_memory(mem_domain)){
+        continue;
+      }
+      settings.placement_node = mem_domain;
+      initialise_benchmark_results(&b_results, repeats);
+      stream_memory_task(&b_results, world_comm, domain_comm, array_size, settings, repeats);
+      // As for the node results, the slowest process limits each repeat, and the best repeat is used
+      node_best_times(&b_results, domain_comm, best_times);
+      for(i=0; i<num_kernels; i++){
+        if(!b_results.results[i].used){
+          continue;
+        }
+        size = (double)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * type->size * array_size * domain_comm.size;
+        if(domain_comm.rank == ROOT){
+          matrix[(i*num_domains + domain)*num_domains + mem_domain] = (1.0E-06 * size)/best_times[i];
+        }
+      }
+      free_benchmark_results(&b_results);
+    }
+  }
+
+  // Only the first process of each CPU domain holds its row of the matrix
+  if(node_comm.rank == ROOT){
+    MPI_Reduce(MPI_IN_PLACE, matrix, matrix_size, MPI_DOUBLE, MPI_MAX, ROOT, node_comm.comm);
+    if(root_comm.rank == ROOT){
+      all_node_matrices = malloc((size_t)root_comm.size * matrix_size * sizeof(double));
+      node_names = malloc((size_t)root_comm.size * sizeof(*node_names));
+    }
+    get_node_name(name);
+    gather_nodes(matrix, matrix_size * sizeof(double), all_node_matrices, root_comm);
+    gather_nodes(name, MPI_MAX_PROCESSOR_NAME, node_names, root_comm);
+  }else{
+    MPI_Reduce(matrix, NULL, matrix_size, MPI_DOUBLE, MPI_MAX, ROOT, node_comm.comm);
+  }
+
+  if(world_comm.rank == ROOT){
+    // Print the matrix averaged over the nodes, the per node matrices are in the results file
+    for(i=0; i<num_kernels; i++){
+      if(!kernel_registry[i].enabled){
+        continue;
+      }
+      printf("%s bandwidth (MB/s), CPU domain (rows) to memory domain (columns), average of %d nodes\n", kernel_registry[i].name, root_comm.size);
+      printf("      ");
+      for(mem_domain=0; mem_domain<num_domains; mem_domain++){
+        printf("   %12d", mem_domain);
+      }
+      printf("\n");
+      for(domain=0; domain<num_domains; domain++){
+        printf("%-6d", domain);
+        for(mem_domain=0; mem_domain<num_domains; mem_domain++){
+          size = 0;
+          for(k=0; k<root_comm.size; k++){
+            size = size + all_node_matrices[k*matrix_size + (i*num_domains + domain)*num_domains + mem_domain];
+          }
+          printf("   %12.1f", size/root_comm.size);
+        }
+        printf("\n");
+      }
+    }
+    save_numa_matrix(filename, all_node_matrices, node_names, num_domains, type, node_comm, root_comm);
+    free(all_node_matrices);
+    free(node_names);
+  }
 
-  free(b_results->Copy.raw_result);
-  free(b_results->Scale.raw_result);
-  free(b_results->Add.raw_result);
-  free(b_results->Triad.raw_result);
+  free(matrix);
+  MPI_Comm_free(&domain_comm.comm);
 
 }
 
-// Print out aggregate results. The intention is that this will only
-// be called from the root process as the overall design is that
-// only the root process (the process which has ROOT rank) will
-// have this data.
-void print_results(aggregate_results a_results, aggregate_results node_results, communicator world_comm, size_t array_size, communicator node_comm){
+// The percentiles of the bandwidth reported from the quantile sketches
+const int bandwidth_percentiles[NUM_PERCENTILES] = {5, 50, 95, 99};
 
-  int omp_num_threads;
-  double bandwidth_avg, bandwidth_max, bandwidth_min;
-  double copy_size = 2 * sizeof(STREAM_TYPE) * array_size;
-  double scale_size = 2 * sizeof(STREAM_TYPE) * array_size;
-  double add_size	= 3 * sizeof(STREAM_TYPE) * array_size;
-  double triad_size = 3 * sizeof(STREAM_TYPE) * array_size;
+// Nodes are gathered in groups of this many, each group by its first node and then the groups by
+// the root, so no process receives from more than about the square root of the number of nodes.
+// When 0 the group size is the square root of the number of nodes, but at least
+// MIN_NODE_GROUP_SIZE (so smaller jobs are gathered in a single step).
+#ifndef NODE_GROUP_SIZE
+#  define NODE_GROUP_SIZE 0
+#endif
+#define MIN_NODE_GROUP_SIZE 32
 
+// The nodes of the group this node is in, and the first nodes of all the groups (only valid on
+// the first node of each group). Both are only set up on the first process of each node.
+static communicator group_comm;
+static communicator leader_comm;
+static int node_group_size;
 
-#pragma omp parallel default(shared)
-  {
-    omp_num_threads = omp_get_num_threads();
+// Split the nodes (the first processes of the nodes in root_comm) into consecutive groups for
+// gather_nodes. This must be called by the first process of every node.
+void setup_node_groups(communicator root_comm){
+
+  MPI_Comm temp_comm;
+
+  node_group_size = NODE_GROUP_SIZE;
+  if(node_group_size <= 0){
+    node_group_size = MAX((int)ceil(sqrt((double)root_comm.size)), MIN_NODE_GROUP_SIZE);
   }
-  printf("Running with %d MPI processes, each with %d OpenMP threads. %d processes per node\n", world_comm.size, omp_num_threads, node_comm.size);
-  printf("Benchmark   Average Bandwidth    Avg Time    Max Bandwidth   Min Time    Min Bandwidth   Max Time   Max Time Location\n");
-  printf("                  (MB/s)         (seconds)       (MB/s)      (seconds)       (MB/s)      (seconds)      (proc name)\n");
-  printf("----------------------------------------------------------------------------------------------------------------------\n");
 
-  // Calculate the bandwidths. Max bandwidth is achieved using the min time (i.e. the fast time). This is
-  // why max and min are opposite either side of the "=" below
-  bandwidth_avg = (1.0E-06 * copy_size)/a_results.Copy.avg;
-  bandwidth_max = (1.0E-06 * copy_size)/a_results.Copy.min;
-  bandwidth_min = (1.0E-06 * copy_size)/a_results.Copy.max;
-  printf("Copy:     %12.1f:   %11.6f:  %12.1f:   %11.6f:   %12.1f:   %11.6f   %s\n", bandwidth_avg, a_results.Copy.avg, bandwidth_max, a_results.Copy.min, bandwidth_min, a_results.Copy.max, a_results.copy_max);
-
-  // Calculate the bandwidths. Max bandwidth is achieved using the min time (i.e. the fast time). This is
-  // why max and min are opposite either side of the "=" below
-  bandwidth_avg = (1.0E-06 * scale_size)/a_results.Scale.avg;
-  bandwidth_max = (1.0E-06 * scale_size)/a_results.Scale.min;
-  bandwidth_min = (1.0E-06 * scale_size)/a_results.Scale.max;
-  printf("Scale:    %12.1f:   %11.6f:  %12.1f:   %11.6f:   %12.1f:   %11.6f   %s\n", bandwidth_avg, a_results.Scale.avg, bandwidth_max, a_results.Scale.min, bandwidth_min, a_results.Scale.max, a_results.scale_max);
-
-  // Calculate the bandwidths. Max bandwidth is achieved using the min time (i.e. the fast time). This is
-  // why max and min are opposite either side of the "=" below
-  bandwidth_avg = (1.0E-06 * add_size)/a_results.Add.avg;
-  bandwidth_max = (1.0E-06 * add_size)/a_results.Add.min;
-  bandwidth_min = (1.0E-06 * add_size)/a_results.Add.max;
-  printf("Add:      %12.1f:   %11.6f:  %12.1f:   %11.6f:   %12.1f:   %11.6f   %s\n", bandwidth_avg, a_results.Add.avg, bandwidth_max, a_results.Add.min, bandwidth_min, a_results.Add.max, a_results.add_max);
-
-  // Calculate the bandwidths. Max bandwidth is achieved using the min time (i.e. the fast time). This is
-  // why max and min are opposite either side of the "=" below
-  bandwidth_avg = (1.0E-06 * triad_size)/a_results.Triad.avg;
-  bandwidth_max = (1.0E-06 * triad_size)/a_results.Triad.min;
-  bandwidth_min = (1.0E-06 * triad_size)/a_results.Triad.max;
-  printf("Triad:    %12.1f:   %11.6f:  %12.1f:   %11.6f:   %12.1f:   %11.6f   %s\n", bandwidth_avg, a_results.Triad.avg, bandwidth_max, a_results.Triad.min, bandwidth_min, a_results.Triad.max, a_results.triad_max);
-
-  // Calculate the node bandwidths.
-  bandwidth_avg = ((1.0E-06 * copy_size * node_comm.size)/node_results.Copy.avg);
-  bandwidth_max = ((1.0E-06 * copy_size * node_comm.size)/node_results.Copy.min);
-  bandwidth_min = ((1.0E-06 * copy_size * node_comm.size)/node_results.Copy.max);
-  printf("Node Copy:  %12.1f:   %11.6f:  %12.1f:   %11.6f:   %12.1f:   %11.6f\n", bandwidth_avg, node_results.Copy.avg, bandwidth_max, node_results.Copy.min, bandwidth_min, node_results.Copy.max);
-
-  // Calculate the node bandwidths.
-  bandwidth_avg = ((1.0E-06 * scale_size * node_comm.size)/node_results.Scale.avg);
-  bandwidth_max = ((1.0E-06 * scale_size * node_comm.size)/node_results.Scale.min);
-  bandwidth_min = ((1.0E-06 * scale_size * node_comm.size)/node_results.Scale.max);
-  printf("Node Scale: %12.1f:   %11.6f:  %12.1f:   %11.6f:   %12.1f:   %11.6f\n", bandwidth_avg, node_results.Scale.avg, bandwidth_max, node_results.Scale.min, bandwidth_min, node_results.Scale.max);
-
-  // Calculate the node bandwidths.
-  bandwidth_avg = ((1.0E-06 * add_size * node_comm.size)/node_results.Add.avg);
-  bandwidth_max = ((1.0E-06 * add_size * node_comm.size)/node_results.Add.min);
-  bandwidth_min = ((1.0E-06 * add_size * node_comm.size)/node_results.Add.max);
-  printf("Node Add:   %12.1f:   %11.6f:  %12.1f:   %11.6f:   %12.1f:   %11.6f\n", bandwidth_avg, node_results.Add.avg, bandwidth_max, node_results.Add.min, bandwidth_min, node_results.Add.max);
-
-  // Calculate the node bandwidths.
-  bandwidth_avg = ((1.0E-06 * triad_size * node_comm.size)/node_results.Triad.avg);
-  bandwidth_max = ((1.0E-06 * triad_size * node_comm.size)/node_results.Triad.min);
-  bandwidth_min = ((1.0E-06 * triad_size * node_comm.size)/node_results.Triad.max);
-  printf("Node Triad: %12.1f:   %11.6f:  %12.1f:   %11.6f:   %12.1f:   %11.6f\n", bandwidth_avg, node_results.Triad.avg, bandwidth_max, node_results.Triad.min, bandwidth_min, node_results.Triad.max);
+  MPI_Comm_split(root_comm.comm, root_comm.rank/node_group_size, root_comm.rank, &temp_comm);
+  group_comm.comm = temp_comm;
+  MPI_Comm_size(temp_comm, &group_comm.size);
+  MPI_Comm_rank(temp_comm, &group_comm.rank);
+
+  MPI_Comm_split(root_comm.comm, (group_comm.rank == ROOT) ? 0 : MPI_UNDEFINED, root_comm.rank, &temp_comm);
+  leader_comm.comm = temp_comm;
+  leader_comm.size = 0;
+  leader_comm.rank = -1;
+  if(temp_comm != MPI_COMM_NULL){
+    MPI_Comm_size(temp_comm, &leader_comm.size);
+    MPI_Comm_rank(temp_comm, &leader_comm.rank);
+  }
 
-  return;
+}
+
+void free_node_groups(){
+
+  MPI_Comm_free(&group_comm.comm);
+  if(leader_comm.comm != MPI_COMM_NULL){
+    MPI_Comm_free(&leader_comm.comm);
+  }
 
 }
 
-// Save to file node results. The intention is that this will only
-// be called from the root process as the overall design is that
-// only the root process (the process which has ROOT rank) will
-// have this data.
-void save_results(char *filename, benchmark_results *all_node_results, size_t array_size, communicator world_comm, communicator node_comm, communicator root_comm){
+// Gather a block of bytes from the first process of every node into recv on the root, in node
+// order, as MPI_Gather over root_comm would. This must be called by the first process of every
+// node. The blocks are gathered by the first node of each group and then passed on to the root
+// a group at a time, so apart from the root no process holds more than a group of blocks.
+void gather_nodes(void *send, int bytes, void *recv, communicator root_comm){
+
+  char *group_blocks = NULL;
+  int *counts, *displacements;
+  int k;
+
+  // The root's group is the first, so it is gathered straight into place
+  if(root_comm.rank == ROOT){
+    group_blocks = recv;
+  }else if(group_comm.rank == ROOT){
+    group_blocks = malloc((size_t)group_comm.size * bytes);
+  }
+  MPI_Gather(send, bytes, MPI_BYTE, group_blocks, bytes, MPI_BYTE, ROOT, group_comm.comm);
+
+  if(group_comm.rank != ROOT){
+    return;
+  }
+  if(root_comm.rank == ROOT){
+    counts = malloc(leader_comm.size * sizeof(int));
+    displacements = malloc(leader_comm.size * sizeof(int));
+    for(k=0; k<leader_comm.size; k++){
+      displacements[k] = k * node_group_size * bytes;
+      counts[k] = (MIN(root_comm.size, (k+1)*node_group_size) - k*node_group_size) * bytes;
+    }
+    MPI_Gatherv(MPI_IN_PLACE, 0, MPI_BYTE, recv, counts, displacements, MPI_BYTE, ROOT, leader_comm.comm);
+    free(counts);
+    free(displacements);
+  }else{
+    MPI_Gatherv(group_blocks, group_comm.size * bytes, MPI_BYTE, NULL, NULL, NULL, MPI_BYTE, ROOT, leader_comm.comm);
+    free(group_blocks);
+  }
+
+}
+
+void collect_results(benchmark_results b_results, aggregate_results *a_results, aggregate_results *node_results, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm, int repeats){
+
+  int i, k;
+  unsigned long long array_size;
+  unsigned long long *node_array_sizes = NULL;
+  double *node_numa_pages = NULL;
+  double node_values[6];
+  double node_validation_time;
+  double *all_node_values = NULL;
+
+  // The node results are reused between tasks so clear out which kernels were
+  // used by the previous task before collecting the results for this one.
+  if(world_comm.rank == ROOT){
+    for(k=0; k<root_comm.size; k++){
+      for(i=0; i<num_kernels; i++){
+        all_node_results[k].results[i].used = 0;
+        all_node_results[k].results[i].imbalance = 0;
+        all_node_results[k].results[i].max_imbalance = 0;
+      }
+    }
+  }
+
+  // The validation is timed separately from the kernels, and the slowest process holds up the node
+  MPI_Reduce(&b_results.validation_time, &node_validation_time, 1, MPI_DOUBLE, MPI_MAX, ROOT, node_comm.comm);
+
+  // Array sizes can differ between nodes, so keep the size used on each node alongside its results.
+  // Only the root receives the gathered values, so only the root holds a buffer for every node.
+  if(node_comm.rank == ROOT){
+    if(root_comm.rank == ROOT){
+      node_array_sizes = malloc(root_comm.size * sizeof(unsigned long long));
+      node_numa_pages = malloc((size_t)root_comm.size * MAX_NUMA_DOMAINS * sizeof(double));
+      all_node_values = malloc((size_t)root_comm.size * 6 * sizeof(double));
+    }
+    array_size = b_results.array_size;
+    gather_nodes(&array_size, sizeof(unsigned long long), node_array_sizes, root_comm);
+    if(root_comm.rank == ROOT){
+      for(k=0; k<root_comm.size; k++){
+        all_node_results[k].array_size = node_array_sizes[k];
+      }
+      free(node_array_sizes);
+    }
+    // The NUMA placement has already been summed over the node by the task
+    gather_nodes(b_results.numa_pages, MAX_NUMA_DOMAINS * sizeof(double), node_numa_pages, root_comm);
+    if(root_comm.rank == ROOT){
+      for(k=0; k<root_comm.size; k++){
+        memcpy(all_node_results[k].numa_pages, &node_numa_pages[k*MAX_NUMA_DOMAINS], MAX_NUMA_DOMAINS * sizeof(double));
+      }
+      free(node_numa_pages);
+    }
+    // The page mode is the same everywhere, but the coverage obtained, the OpenMP overheads,
+    // the repeats run, and the validation time, are not
+    node_values[0] = b_results.huge_page_bytes;
+    node_values[1] = b_results.resident_bytes;
+    node_values[2] = b_results.fork_join_time;
+    node_values[3] = b_results.team_barrier_time;
+    node_values[4] = b_results.repeats;
+    node_values[5] = node_validation_time;
+    gather_nodes(node_values, 6 * sizeof(double), all_node_values, root_comm);
+    if(root_comm.rank == ROOT){
+      a_results->validation_time = -1;
+      for(k=0; k<root_comm.size; k++){
+        all_node_results[k].pages = b_results.pages;
+        all_node_results[k].huge_page_bytes = all_node_values[6*k];
+        all_node_results[k].resident_bytes = all_node_values[6*k+1];
+        all_node_results[k].fork_join_time = all_node_values[6*k+2];
+        all_node_results[k].team_barrier_time = all_node_values[6*k+3];
+        all_node_results[k].repeats = (int)all_node_values[6*k+4];
+        all_node_results[k].validation_time = all_node_values[6*k+5];
+        a_results->validation_time = MAX(a_results->validation_time, all_node_values[6*k+5]);
+      }
+      free(all_node_values);
+    }
+  }
+
+  for(i=0; i<num_kernels; i++){
+    a_results->results[i].used = b_results.results[i].used;
+    node_results->results[i].used = b_results.results[i].used;
+  }
+  collect_kernel_results(&b_results, a_results, node_results, all_node_results, world_comm, node_comm, root_comm, repeats);
+
+}
+
+// The per process statistics of a kernel, reduced over all the processes together. The
+// locations are the index of the node (in root_comm) the value came from, stored as a double
+// so the whole structure is a block of doubles.
+typedef struct process_stats {
+  double avg;
+  double max;
+  double max_node;
+  double min;
+  double min_node;
+  double imbalance;
+  double max_imbalance;
+  double max_imbalance_node;
+} process_stats;
+
+// The per node statistics of a kernel, gathered from the first process of each node
+typedef struct node_stats {
+  double avg;
+  double max;
+  double min;
+  double confidence;
+  double imbalance;
+  double max_imbalance;
+  double percentiles[NUM_PERCENTILES];
+} node_stats;
+
+// Reduction of process_stats: sum the averages and imbalances, and keep the largest (or
+// smallest) value along with its location. Ties go to the lowest node, as with MPI_MAXLOC.
+static void process_stats_op(void *in, void *inout, int *len, MPI_Datatype *type){
+
+  process_stats *a = (process_stats *)in;
+  process_stats *b = (process_stats *)inout;
+  int i;
+
+  for(i=0; i<*len; i++){
+    b[i].avg = b[i].avg + a[i].avg;
+    if(a[i].max > b[i].max || (a[i].max == b[i].max && a[i].max_node < b[i].max_node)){
+      b[i].max = a[i].max;
+      b[i].max_node = a[i].max_node;
+    }
+    if(a[i].min < b[i].min || (a[i].min == b[i].min && a[i].min_node < b[i].min_node)){
+      b[i].min = a[i].min;
+      b[i].min_node = a[i].min_node;
+    }
+    b[i].imbalance = b[i].imbalance + a[i].imbalance;
+    if(a[i].max_imbalance > b[i].max_imbalance || (a[i].max_imbalance == b[i].max_imbalance && a[i].max_imbalance_node < b[i].max_imbalance_node)){
+      b[i].max_imbalance = a[i].max_imbalance;
+      b[i].max_imbalance_node = a[i].max_imbalance_node;
+    }
+  }
+
+}
+
+// Reduction of pairs of doubles, summing the first and keeping the largest second. The
+// node time of a repeat is that of the slowest process, while the node average and the
+// thread imbalance need the total.
+static void sum_max_op(void *in, void *inout, int *len, MPI_Datatype *type){
+
+  double *a = (double *)in;
+  double *b = (double *)inout;
+  int i;
+
+  for(i=0; i<*len; i++){
+    b[2*i] = b[2*i] + a[2*i];
+    b[2*i+1] = MAX(b[2*i+1], a[2*i+1]);
+  }
+
+}
+
+// Collect the results of all the kernels a task has used. For processes these are the
+// average time over all the processes, and the slowest and fastest of them. For nodes the
+// time of a repeat is the time of the slowest process on the node (each kernel is surrounded
+// by barriers, so the slowest process limits the bandwidth of the node), giving the average,
+// the slowest and the fastest repeat of each node, and over all the nodes the average node,
+// the slowest node and the fastest node. The thread imbalance is collected in the same way
+// when the threads have been timed. As in the original STREAM benchmark the first repeat is
+// not counted.
+//
+// Rather than reducing each statistic of each repeat separately, the statistics of all the
+// kernels are packed into arrays and reduced together using custom operations: one
+// reduction over the whole job for the process statistics, one over each node for the
+// repeats, and one gather over the nodes, whatever the number of kernels and repeats.
+//
+// The distribution of the times is kept as a quantile sketch of the times of each process,
+// merged over each node and then over all the nodes, which gives the percentiles of the
+// bandwidth of each node and of the whole system (see bandwidth_percentiles) without keeping
+// the raw times.
+void collect_kernel_results(benchmark_results *b_results, aggregate_results *a_results, aggregate_results *node_results, benchmark_results *all_node_results, communicator world_comm, communicator node_comm, communicator root_comm, int repeats){
+
+  process_stats local_stats[num_kernels];
+  process_stats job_stats[num_kernels];
+  node_stats local_node_stats[num_kernels];
+  node_stats *all_node_stats = NULL;
+  char (*node_names)[MPI_MAX_PROCESSOR_NAME] = NULL;
+  double *times, *node_times;
+  double *sketches, *node_sketches = NULL, *system_sketches = NULL;
+  double imbalance, node_threads;
+  running_stats repeat_stats;
+  performance_result *indivi, *result, *node_result;
+  MPI_Datatype stats_type, pair_type;
+  MPI_Op stats_op, pair_op;
+  int thread_timing = 0;
+  int node_index, count, used;
+  int i, j, k, p;
+
+  used = 0;
+  for(i=0; i<num_kernels; i++){
+    // Thread timing is switched on or off for all the processes together
+    if(b_results->results[i].used && b_results->results[i].thread_raw_result != NULL){
+      thread_timing = 1;
+    }
+    used = used + b_results->results[i].used;
+  }
+
+  // The node names are gathered once, and the locations of the slowest processes are found
+  // from the index of their node
+  node_index = root_comm.rank;
+  MPI_Bcast(&node_index, 1, MPI_INT, ROOT, node_comm.comm);
+  if(node_comm.rank == ROOT){
+    if(root_comm.rank == ROOT){
+      node_names = malloc((size_t)root_comm.size * MPI_MAX_PROCESSOR_NAME);
+    }
+    gather_nodes(b_results->name, MPI_MAX_PROCESSOR_NAME, node_names, root_comm);
+  }
+
+  MPI_Type_contiguous(sizeof(process_stats)/sizeof(double), MPI_DOUBLE, &stats_type);
+  MPI_Type_commit(&stats_type);
+  MPI_Op_create(process_stats_op, 1, &stats_op);
+  MPI_Type_contiguous(2, MPI_DOUBLE, &pair_type);
+  MPI_Type_commit(&pair_type);
+  MPI_Op_create(sum_max_op, 1, &pair_op);
+
+  /* --- Processes --- */
+  for(i=0; i<num_kernels; i++){
+    indivi = &b_results->results[i];
+    local_stats[i].avg = indivi->avg;
+    local_stats[i].max = indivi->max;
+    local_stats[i].max_node = node_index;
+    local_stats[i].min = indivi->min;
+    local_stats[i].min_node = node_index;
+    local_stats[i].imbalance = 0;
+    local_stats[i].max_imbalance = 0;
+    local_stats[i].max_imbalance_node = node_index;
+    if(indivi->used && indivi->thread_raw_result != NULL){
+      local_stats[i].imbalance = indivi->imbalance;
+      local_stats[i].max_imbalance = indivi->max_imbalance;
+    }
+  }
+  MPI_Reduce(local_stats, job_stats, num_kernels, stats_type, stats_op, ROOT, world_comm.comm);
+
+  /* --- Nodes --- */
+  // For each kernel, the repeats as (total, slowest) pairs of the process times, then if the
+  // threads were timed, the number of threads and the repeats as (total, slowest) pairs of
+  // the thread times
+  times = malloc((size_t)2 * num_kernels * (thread_timing + 1) * repeats * sizeof(double));
+  count = 0;
+  for(i=0; i<num_kernels; i++){
+    indivi = &b_results->results[i];
+    if(!indivi->used){
+      continue;
+    }
+    for(k=1; k<repeats; k++){
+      times[2*count] = indivi->raw_result[k];
+      times[2*count+1] = indivi->raw_result[k];
+      count++;
+    }
+    if(indivi->thread_raw_result != NULL){
+      times[2*count] = b_results->num_threads;
+      times[2*count+1] = b_results->num_threads;
+      count++;
+      for(k=1; k<repeats; k++){
+        times[2*count] = 0;
+        times[2*count+1] = 0;
+        for(j=0; j<b_results->num_threads; j++){
+          times[2*count] = times[2*count] + indivi->thread_raw_result[k*b_results->num_threads + j];
+          times[2*count+1] = MAX(times[2*count+1], indivi->thread_raw_result[k*b_results->num_threads + j]);
+        }
+        count++;
+      }
+    }
+  }
+  node_times = NULL;
+  if(node_comm.rank == ROOT){
+    node_times = malloc((size_t)2 * MAX(count, 1) * sizeof(double));
+  }
+  MPI_Reduce(times, node_times, count, pair_type, pair_op, ROOT, node_comm.comm);
+  free(times);
+
+  // The sketches of the kernels that were used, one after the other
+  sketches = calloc((size_t)MAX(used, 1) * SKETCH_BUCKETS, sizeof(double));
+  count = 0;
+  for(i=0; i<num_kernels; i++){
+    if(!b_results->results[i].used){
+      continue;
+    }
+    for(k=1; k<repeats; k++){
+      sketch_add(&sketches[count*SKETCH_BUCKETS], b_results->results[i].raw_result[k]);
+    }
+    count++;
+  }
+  if(node_comm.rank == ROOT){
+    node_sketches = malloc((size_t)MAX(used, 1) * SKETCH_BUCKETS * sizeof(double));
+  }
+  MPI_Reduce(sketches, node_sketches, used * SKETCH_BUCKETS, MPI_DOUBLE, MPI_SUM, ROOT, node_comm.comm);
+  free(sketches);
+
+  if(node_comm.rank == ROOT){
+    count = 0;
+    for(i=0; i<num_kernels; i++){
+      memset(&local_node_stats[i], 0, sizeof(node_stats));
+      if(!b_results->results[i].used){
+        continue;
+      }
+      local_node_stats[i].min = FLT_MAX;
+      repeat_stats.count = 0;
+      repeat_stats.mean = 0;
+      repeat_stats.m2 = 0;
+      for(k=1; k<repeats; k++){
+        local_node_stats[i].avg = local_node_stats[i].avg + node_times[2*count]/node_comm.size;
+        local_node_stats[i].max = MAX(local_node_stats[i].max, node_times[2*count+1]);
+        local_node_stats[i].min = MIN(local_node_stats[i].min, node_times[2*count+1]);
+        running_stats_add(&repeat_stats, node_times[2*count+1]);
+        count++;
+      }
+      local_node_stats[i].avg = local_node_stats[i].avg/(repeats-1);
+      // How precisely the repeats pin down the node time (the statistic the adaptive mode stops on)
+      local_node_stats[i].confidence = relative_confidence(&repeat_stats);
+      if(b_results->results[i].thread_raw_result != NULL){
+        node_threads = node_times[2*count];
+        count++;
+        for(k=1; k<repeats; k++){
+          if(node_times[2*count] > 0){
+            imbalance = node_times[2*count+1]/(node_times[2*count]/node_threads);
+            local_node_stats[i].imbalance = local_node_stats[i].imbalance + imbalance;
+            local_node_stats[i].max_imbalance = MAX(local_node_stats[i].max_imbalance, imbalance);
+          }
+          count++;
+        }
+        local_node_stats[i].imbalance = local_node_stats[i].imbalance/(repeats-1);
+      }
+    }
+    free(node_times);
+
+    // The low bandwidth percentiles are the high time quantiles
+    count = 0;
+    for(i=0; i<num_kernels; i++){
+      if(!b_results->results[i].used){
+        continue;
+      }
+      for(p=0; p<NUM_PERCENTILES; p++){
+        local_node_stats[i].percentiles[p] = sketch_quantile(&node_sketches[count*SKETCH_BUCKETS], 1.0 - bandwidth_percentiles[p]/100.0);
+      }
+      count++;
+    }
+    if(root_comm.rank == ROOT){
+      system_sketches = malloc((size_t)MAX(used, 1) * SKETCH_BUCKETS * sizeof(double));
+    }
+    MPI_Reduce(node_sketches, system_sketches, used * SKETCH_BUCKETS, MPI_DOUBLE, MPI_SUM, ROOT, root_comm.comm);
+    free(node_sketches);
+
+    if(root_comm.rank == ROOT){
+      all_node_stats = malloc((size_t)root_comm.size * num_kernels * sizeof(node_stats));
+    }
+    gather_nodes(local_node_stats, num_kernels * sizeof(node_stats), all_node_stats, root_comm);
+  }
+
+  MPI_Op_free(&stats_op);
+  MPI_Type_free(&stats_type);
+  MPI_Op_free(&pair_op);
+  MPI_Type_free(&pair_type);
+
+  if(world_comm.rank != ROOT){
+    return;
+  }
+
+  for(k=0; k<root_comm.size; k++){
+    strcpy(all_node_results[k].name, node_names[k]);
+  }
+
+  count = 0;
+  for(i=0; i<num_kernels; i++){
+    if(!b_results->results[i].used){
+      continue;
+    }
+    result = &a_results->results[i];
+    node_result = &node_results->results[i];
+
+    for(p=0; p<NUM_PERCENTILES; p++){
+      node_result->percentiles[p] = sketch_quantile(&system_sketches[count*SKETCH_BUCKETS], 1.0 - bandwidth_percentiles[p]/100.0);
+    }
+    count++;
+
+    result->avg = job_stats[i].avg/world_comm.size;
+    result->max = job_stats[i].max;
+    result->min = job_stats[i].min;
+    // The node with the slowest process, so outlier nodes can be identified
+    strcpy(a_results->max_names[i], node_names[(int)job_stats[i].max_node]);
+    result->imbalance = 0;
+    result->max_imbalance = 0;
+    node_result->imbalance = 0;
+    node_result->max_imbalance = 0;
+    if(b_results->results[i].thread_raw_result != NULL){
+      result->imbalance = job_stats[i].imbalance/world_comm.size;
+      result->max_imbalance = job_stats[i].max_imbalance;
+      strcpy(a_results->imbalance_names[i], node_names[(int)job_stats[i].max_imbalance_node]);
+    }
+
+    // For the max we want the slowest node and for the min the fastest node, which give the
+    // upper and lower bounds on the node performances
+    node_result->avg = 0;
+    node_result->max = 0;
+    node_result->min = FLT_MAX;
+    node_result->confidence = local_node_stats[i].confidence;
+    for(k=0; k<root_comm.size; k++){
+      all_node_results[k].results[i].avg = all_node_stats[k*num_kernels + i].avg;
+      all_node_results[k].results[i].max = all_node_stats[k*num_kernels + i].max;
+      all_node_results[k].results[i].min = all_node_stats[k*num_kernels + i].min;
+      all_node_results[k].results[i].confidence = all_node_stats[k*num_kernels + i].confidence;
+      all_node_results[k].results[i].imbalance = all_node_stats[k*num_kernels + i].imbalance;
+      all_node_results[k].results[i].max_imbalance = all_node_stats[k*num_kernels + i].max_imbalance;
+      memcpy(all_node_results[k].results[i].percentiles, all_node_stats[k*num_kernels + i].percentiles, NUM_PERCENTILES * sizeof(double));
+      all_node_results[k].results[i].used = 1;
+      node_result->avg = node_result->avg + all_node_stats[k*num_kernels + i].avg;
+      node_result->max = MAX(node_result->max, all_node_stats[k*num_kernels + i].max);
+      node_result->min = MIN(node_result->min, all_node_stats[k*num_kernels + i].min);
+      if(b_results->results[i].thread_raw_result != NULL){
+        node_result->imbalance = node_result->imbalance + all_node_stats[k*num_kernels + i].imbalance;
+        if(all_node_stats[k*num_kernels + i].max_imbalance >= node_result->max_imbalance){
+          node_result->max_imbalance = all_node_stats[k*num_kernels + i].max_imbalance;
+          strcpy(node_results->imbalance_names[i], node_names[k]);
+        }
+      }
+    }
+    node_result->avg = node_result->avg/root_comm.size;
+    node_result->imbalance = node_result->imbalance/root_comm.size;
+  }
+
+  free(all_node_stats);
+  free(node_names);
+  free(system_sketches);
+
+}
+
+// The time of each kernel's best repeat for the processes of a communicator, where the time
+// of a repeat is that of the slowest process (as for the node results). The repeats of all
+// the kernels are reduced together. The processes must have run the same repeats.
+void node_best_times(benchmark_results *b_results, communicator comm, double *best_times){
+
+  double *times;
+  int i, k, count;
+
+  times = malloc((size_t)num_kernels * b_results->repeats * sizeof(double));
+  count = 0;
+  for(i=0; i<num_kernels; i++){
+    if(!b_results->results[i].used){
+      continue;
+    }
+    for(k=1; k<b_results->repeats; k++){
+      times[count++] = b_results->results[i].raw_result[k];
+    }
+  }
+  MPI_Allreduce(MPI_IN_PLACE, times, count, MPI_DOUBLE, MPI_MAX, comm.comm);
+  count = 0;
+  for(i=0; i<num_kernels; i++){
+    best_times[i] = 0;
+    if(!b_results->results[i].used){
+      continue;
+    }
+    best_times[i] = FLT_MAX;
+    for(k=1; k<b_results->repeats; k++){
+      best_times[i] = MIN(best_times[i], times[count]);
+      count++;
+    }
+  }
+  free(times);
+
+}
+
+static int compare_names(const void *a, const void *b){
+  return strcmp((const char *)a, (const char *)b);
+}
+
+// Check the node communicators match the nodes: every process in a node communicator should
+// have the same node name, and no two node communicators should share a name. Either would mean
+// the node results do not describe real nodes (or parts of nodes), so warn about it.
+void check_node_names(communicator world_comm, communicator node_comm, communicator root_comm){
+
+  char name[MPI_MAX_PROCESSOR_NAME];
+  char first_name[MPI_MAX_PROCESSOR_NAME];
+  char (*names)[MPI_MAX_PROCESSOR_NAME] = NULL;
+  int mismatched, total_mismatched;
+  int k;
+
+  get_node_name(name);
+  strcpy(first_name, name);
+  MPI_Bcast(first_name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, ROOT, node_comm.comm);
+  mismatched = (strcmp(name, first_name) != 0);
+  MPI_Reduce(&mismatched, &total_mismatched, 1, MPI_INT, MPI_SUM, ROOT, world_comm.comm);
+  if(world_comm.rank == ROOT && total_mismatched > 0){
+    printf("Warning: %d process(es) have a different node name from the first process of their node communicator.\n", total_mismatched);
+  }
+
+  if(node_comm.rank == ROOT){
+    if(root_comm.rank == ROOT){
+      names = malloc((size_t)root_comm.size * MPI_MAX_PROCESSOR_NAME);
+    }
+    gather_nodes(name, MPI_MAX_PROCESSOR_NAME, names, root_comm);
+    if(root_comm.rank == ROOT){
+      qsort(names, root_comm.size, MPI_MAX_PROCESSOR_NAME, compare_names);
+      for(k=1; k<root_comm.size; k++){
+        if(strcmp(names[k], names[k-1]) == 0 && (k == 1 || strcmp(names[k-1], names[k-2]) != 0)){
+          printf("Warning: %s has more than one node communicator, so its processes are reported as separate nodes.\n", names[k]);
+        }
+      }
+      free(names);
+    }
+  }
+
+}
+
+// Longest description of the placement of a flagged process sent to the root by each node
+#define MAX_PLACEMENT_EXAMPLE 256
+
+// What a node found when checking its thread placement, sent to the root by each node
+typedef struct placement_summary {
+  int flagged;
+  int overlapping;
+  int migrated;
+  char name[MPI_MAX_PROCESSOR_NAME];
+  // Where the threads of the first flagged process ran
+  char example[MAX_PLACEMENT_EXAMPLE];
+} placement_summary;
+
+// Check the placement of every thread of every process on each node, and flag the processes
+// whose threads moved between CPUs while the kernels ran, or that share a CPU with another
+// thread on the same node (from the same or a different process). Either usually means the
+// OpenMP places or the MPI binding are wrong, which is a common cause of slow nodes. The
+// threads are only compared within a node, on the first process of the node, and just a
+// summary of each node is gathered to the root.
+void check_thread_placement(benchmark_results b_results, communicator world_comm, communicator node_comm, communicator root_comm){
+
+  int *ranks = NULL;
+  int *thread_counts = NULL;
+  int *displacements = NULL;
+  thread_placement *threads = NULL;
+  placement_summary placement;
+  placement_summary *all_placements = NULL;
+  int total_threads = 0;
+  int migrated, overlapping, length;
+  int total_flagged = 0;
+  int rank, i, j, k;
+  thread_placement *thread, *other_thread;
+
+  if(node_comm.rank == ROOT){
+    ranks = malloc(node_comm.size * sizeof(int));
+    thread_counts = malloc(node_comm.size * sizeof(int));
+    displacements = malloc(node_comm.size * sizeof(int));
+  }
+  MPI_Gather(&world_comm.rank, 1, MPI_INT, ranks, 1, MPI_INT, ROOT, node_comm.comm);
+  // The placement is sent as plain integers, four for each thread
+  i = b_results.num_threads * 4;
+  MPI_Gather(&i, 1, MPI_INT, thread_counts, 1, MPI_INT, ROOT, node_comm.comm);
+  if(node_comm.rank == ROOT){
+    for(rank=0; rank<node_comm.size; rank++){
+      displacements[rank] = total_threads * 4;
+      total_threads = total_threads + thread_counts[rank]/4;
+    }
+    threads = malloc((size_t)total_threads * sizeof(thread_placement));
+  }
+  MPI_Gatherv(b_results.threads, b_results.num_threads * 4, MPI_INT, threads, thread_counts, displacements, MPI_INT, ROOT, node_comm.comm);
+
+  if(node_comm.rank != ROOT){
+    return;
+  }
+
+  placement.flagged = 0;
+  placement.overlapping = 0;
+  placement.migrated = 0;
+  placement.example[0] = '\0';
+  strcpy(placement.name, b_results.name);
+  for(rank=0; rank<node_comm.size; rank++){
+    migrated = 0;
+    overlapping = 0;
+    for(i=0; i<thread_counts[rank]/4; i++){
+      thread = &threads[displacements[rank]/4 + i];
+      if(thread->start_cpu < 0){
+        continue;
+      }
+      if(thread->start_cpu != thread->end_cpu || thread->start_socket != thread->end_socket){
+        migrated++;
+      }
+      // Compare against every other thread on the node
+      for(j=0; j<total_threads; j++){
+        other_thread = &threads[j];
+        if(j != displacements[rank]/4 + i && other_thread->start_cpu == thread->start_cpu){
+          overlapping++;
+          break;
+        }
+      }
+    }
+    if(migrated == 0 && overlapping == 0){
+      continue;
+    }
+    placement.flagged++;
+    placement.overlapping = placement.overlapping + overlapping;
+    placement.migrated = placement.migrated + migrated;
+    if(placement.flagged > 1){
+      continue;
+    }
+    length = snprintf(placement.example, MAX_PLACEMENT_EXAMPLE, "rank %d threads ran on CPU (socket):", ranks[rank]);
+    for(i=0; i<thread_counts[rank]/4 && length < MAX_PLACEMENT_EXAMPLE; i++){
+      thread = &threads[displacements[rank]/4 + i];
+      if(thread->start_cpu == thread->end_cpu){
+        length += snprintf(&placement.example[length], MAX_PLACEMENT_EXAMPLE - length, " %d(%d)", thread->start_cpu, thread->start_socket);
+      }else{
+        length += snprintf(&placement.example[length], MAX_PLACEMENT_EXAMPLE - length, " %d(%d)->%d(%d)", thread->start_cpu, thread->start_socket, thread->end_cpu, thread->end_socket);
+      }
+    }
+  }
+
+  free(ranks);
+  free(thread_counts);
+  free(displacements);
+  free(threads);
+
+  if(root_comm.rank == ROOT){
+    all_placements = malloc(root_comm.size * sizeof(placement_summary));
+  }
+  gather_nodes(&placement, sizeof(placement_summary), all_placements, root_comm);
+  if(root_comm.rank != ROOT){
+    return;
+  }
+
+  for(k=0; k<root_comm.size; k++){
+    if(all_placements[k].flagged == 0){
+      continue;
+    }
+    total_flagged = total_flagged + all_placements[k].flagged;
+    printf("%s: %d process(es) flagged,", all_placements[k].name, all_placements[k].flagged);
+    if(all_placements[k].overlapping > 0){
+      printf(" %d thread(s) share a CPU with another thread,", all_placements[k].overlapping);
+    }
+    if(all_placements[k].migrated > 0){
+      printf(" %d thread(s) migrated during the kernels,", all_placements[k].migrated);
+    }
+    printf(" %s\n", all_placements[k].example);
+  }
+  if(total_flagged == 0){
+    printf("Thread placement: no overlapping or migrating threads on any of the %d processes.\n", world_comm.size);
+  }else{
+    printf("Thread placement: %d of %d processes have overlapping or migrating threads, check the process and thread binding.\n", total_flagged, world_comm.size);
+  }
+
+  free(all_placements);
+
+}
+
+// Initialise the benchmark results structure to enable proper collection of data.
+// Raw results are only allocated for the kernels that are enabled.
+void initialise_benchmark_results(benchmark_results *b_results, int repeats){
+
+  int i;
+
+  b_results->results = malloc(num_kernels * sizeof(struct performance_result));
+  for(i=0; i<num_kernels; i++){
+    b_results->results[i].avg = 0;
+    b_results->results[i].min = FLT_MAX;
+    b_results->results[i].max = 0;
+    b_results->results[i].used = 0;
+    // Tasks that time their threads allocate the thread results themselves
+    b_results->results[i].thread_raw_result = NULL;
+    b_results->results[i].imbalance = 0;
+    b_results->results[i].max_imbalance = 0;
+    b_results->results[i].confidence = 0;
+    if(kernel_registry[i].enabled){
+      b_results->results[i].raw_result = malloc(repeats * sizeof(double));
+    }else{
+      b_results->results[i].raw_result = NULL;
+    }
+  }
+  b_results->array_size = 0;
+  // Tasks that do not record their thread placement leave it as -1
+  b_results->num_threads = omp_get_max_threads();
+  b_results->threads = malloc(b_results->num_threads * sizeof(thread_placement));
+  for(i=0; i<b_results->num_threads; i++){
+    b_results->threads[i].start_cpu = -1;
+    b_results->threads[i].start_socket = -1;
+    b_results->threads[i].end_cpu = -1;
+    b_results->threads[i].end_socket = -1;
+  }
+  // Tasks that do not record their NUMA placement leave this empty
+  for(i=0; i<MAX_NUMA_DOMAINS; i++){
+    b_results->numa_pages[i] = 0;
+  }
+  // Likewise for their huge page coverage
+  b_results->pages = default_pages;
+  b_results->huge_page_bytes = 0;
+  b_results->resident_bytes = 0;
+  b_results->fork_join_time = 0;
+  b_results->team_barrier_time = 0;
+  // Tasks that can stop early change this to the repeats they ran
+  b_results->repeats = repeats;
+  // Tasks that validate their results record how long it took
+  b_results->validation_time = -1;
+  get_node_name(b_results->name);
+
+}
+
+// Free the data allocated by initialise_benchmark_results
+void free_benchmark_results(benchmark_results *b_results){
+
+  int i;
+
+  for(i=0; i<num_kernels; i++){
+    free(b_results->results[i].raw_result);
+    free(b_results->results[i].thread_raw_result);
+  }
+  free(b_results->results);
+  free(b_results->threads);
+
+}
+
+// Calculate the average, minimum, and maximum time for each kernel a task has used
+// from the raw results. As in the original STREAM benchmark the first iteration is
+// skipped.
+void summarise_benchmark_results(benchmark_results *b_results, int repeats){
+
+  int i, k;
+  performance_result *result;
+
+  for(i=0; i<num_kernels; i++){
+    result = &b_results->results[i];
+    if(!result->used){
+      continue;
+    }
+    for(k=1; k<repeats; k++){
+      result->avg = result->avg + result->raw_result[k];
+      result->min = MIN(result->min, result->raw_result[k]);
+      result->max = MAX(result->max, result->raw_result[k]);
+    }
+    result->avg = result->avg/(double)(repeats-1);
+    if(result->thread_raw_result != NULL){
+      summarise_thread_imbalance(result, b_results->num_threads, repeats);
+    }
+  }
+
+}
+
+// Calculate the imbalance between the threads of a process for a kernel, the time of the
+// slowest thread over the mean time of the threads, averaged over the repeats, along with
+// the worst repeat.
+void summarise_thread_imbalance(performance_result *result, int num_threads, int repeats){
+
+  double slowest, total, imbalance;
+  int j, k;
+
+  result->imbalance = 0;
+  result->max_imbalance = 0;
+  for(k=1; k<repeats; k++){
+    slowest = 0;
+    total = 0;
+    for(j=0; j<num_threads; j++){
+      slowest = MAX(slowest, result->thread_raw_result[k*num_threads + j]);
+      total = total + result->thread_raw_result[k*num_threads + j];
+    }
+    imbalance = (total > 0) ? slowest/(total/num_threads) : 0;
+    result->imbalance = result->imbalance + imbalance;
+    result->max_imbalance = MAX(result->max_imbalance, imbalance);
+  }
+  result->imbalance = result->imbalance/(double)(repeats-1);
+
+}
+
+void initialise_aggregate_results(aggregate_results *a_results){
+
+  a_results->results = calloc(num_kernels, sizeof(struct performance_result));
+  a_results->max_names = calloc(num_kernels, sizeof(*a_results->max_names));
+  a_results->imbalance_names = calloc(num_kernels, sizeof(*a_results->imbalance_names));
+  a_results->validation_time = -1;
+
+}
+
+void free_aggregate_results(aggregate_results *a_results){
+
+  free(a_results->results);
+  free(a_results->max_names);
+  free(a_results->imbalance_names);
+
+}
+
+// Allocate the per node results, with space for every kernel for every node
+benchmark_results *initialise_node_results(int num_nodes){
+
+  benchmark_results *all_node_results;
+  performance_result *results;
+  int k;
+
+  all_node_results = malloc(num_nodes * sizeof(struct benchmark_results));
+  results = calloc((size_t)num_nodes * num_kernels, sizeof(struct performance_result));
+  for(k=0; k<num_nodes; k++){
+    all_node_results[k].results = &results[k*num_kernels];
+    all_node_results[k].threads = NULL;
+    all_node_results[k].num_threads = 0;
+  }
+
+  return all_node_results;
+
+}
+
+void free_node_results(benchmark_results *all_node_results){
+
+  free(all_node_results[0].results);
+  free(all_node_results);
+
+}
+
+// Print out aggregate results. The intention is that this will only
+// be called from the root process as the overall design is that
+// only the root process (the process which has ROOT rank) will
+// have this data.
+void print_results(aggregate_results a_results, aggregate_results node_results, communicator world_comm, size_t array_size, int element_size, communicator node_comm){
+
+  int omp_num_threads;
+  int i, p;
+  int printed = 0;
+  double bandwidth_avg, bandwidth_max, bandwidth_min;
+  double size;
+  char label[MAX_FILE_NAME_LENGTH];
+
+
+#pragma omp parallel default(shared)
+  {
+    omp_num_threads = omp_get_num_threads();
+  }
+  printf("Running with %d MPI processes, each with %d OpenMP threads. %d processes per node\n", world_comm.size, omp_num_threads, node_comm.size);
+  printf("Benchmark   Average Bandwidth    Avg Time    Max Bandwidth   Min Time    Min Bandwidth   Max Time   Max Time Location\n");
+  printf("                  (MB/s)         (seconds)       (MB/s)      (seconds)       (MB/s)      (seconds)      (proc name)\n");
+  printf("----------------------------------------------------------------------------------------------------------------------\n");
+
+  for(i=0; i<num_kernels; i++){
+    if(!a_results.results[i].used){
+      continue;
+    }
+    size = (double)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * element_size * array_size;
+    // Calculate the bandwidths. Max bandwidth is achieved using the min time (i.e. the fast time). This is
+    // why max and min are opposite either side of the "=" below
+    bandwidth_avg = (1.0E-06 * size)/a_results.results[i].avg;
+    bandwidth_max = (1.0E-06 * size)/a_results.results[i].min;
+    bandwidth_min = (1.0E-06 * size)/a_results.results[i].max;
+    sprintf(label, "%s:", kernel_registry[i].name);
+    printf("%-10s%12.1f:   %11.6f:  %12.1f:   %11.6f:   %12.1f:   %11.6f   %s\n", label, bandwidth_avg, a_results.results[i].avg, bandwidth_max, a_results.results[i].min, bandwidth_min, a_results.results[i].max, a_results.max_names[i]);
+  }
+
+  for(i=0; i<num_kernels; i++){
+    if(!node_results.results[i].used){
+      continue;
+    }
+    size = (double)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * element_size * array_size;
+    // Calculate the node bandwidths.
+    bandwidth_avg = ((1.0E-06 * size * node_comm.size)/node_results.results[i].avg);
+    bandwidth_max = ((1.0E-06 * size * node_comm.size)/node_results.results[i].min);
+    bandwidth_min = ((1.0E-06 * size * node_comm.size)/node_results.results[i].max);
+    sprintf(label, "Node %s:", kernel_registry[i].name);
+    printf("%-12s%12.1f:   %11.6f:  %12.1f:   %11.6f:   %12.1f:   %11.6f\n", label, bandwidth_avg, node_results.results[i].avg, bandwidth_max, node_results.results[i].min, bandwidth_min, node_results.results[i].max);
+  }
+
+  // The bandwidth of the irregular kernels only counts the elements moved, so also give
+  // the rate elements are processed at, which is what codes using these patterns see.
+  for(i=0; i<num_kernels; i++){
+    if(!node_results.results[i].used || !kernel_registry[i].irregular){
+      continue;
+    }
+    size = (double)array_size * node_comm.size;
+    sprintf(label, "Node %s:", kernel_registry[i].name);
+    printf("%-20s%12.1f  %12.1f  %12.1f  (million elements/s, average, max, min)\n", label, (1.0E-06 * size)/node_results.results[i].avg, (1.0E-06 * size)/node_results.results[i].min, (1.0E-06 * size)/node_results.results[i].max);
+  }
+
+  // The spread of the node bandwidth over all the processes and repeats, which shows the long
+  // tail of slow repeats and processes that the averages hide
+  printf("Node bandwidth percentiles (MB/s), over all the processes and repeats of all the nodes\n");
+  printf("Benchmark   ");
+  for(p=0; p<NUM_PERCENTILES; p++){
+    sprintf(label, "p%d", bandwidth_percentiles[p]);
+    printf("%12s", label);
+  }
+  printf("\n");
+  for(i=0; i<num_kernels; i++){
+    if(!node_results.results[i].used || node_results.results[i].percentiles[0] <= 0){
+      continue;
+    }
+    size = (double)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * element_size * array_size * node_comm.size;
+    sprintf(label, "Node %s:", kernel_registry[i].name);
+    printf("%-12s", label);
+    for(p=0; p<NUM_PERCENTILES; p++){
+      printf("%12.1f", (1.0E-06 * size)/node_results.results[i].percentiles[p]);
+    }
+    printf("\n");
+  }
+
+  // The thread imbalance is only known if the threads were timed
+  for(i=0; i<num_kernels; i++){
+    if(!a_results.results[i].used || a_results.results[i].imbalance <= 0){
+      continue;
+    }
+    if(!printed){
+      printf("Thread imbalance (slowest thread time / mean thread time, 1.0 is perfectly balanced)\n");
+      printf("Benchmark   Process Avg  Process Worst   Worst Location      Node Avg   Node Worst   Worst Location\n");
+    }
+    printed = 1;
+    sprintf(label, "%s:", kernel_registry[i].name);
+    printf("%-12s%11.3f  %13.3f   %-18s %9.3f  %11.3f   %s\n", label, a_results.results[i].imbalance, a_results.results[i].max_imbalance, a_results.imbalance_names[i], node_results.results[i].imbalance, node_results.results[i].max_imbalance, node_results.imbalance_names[i]);
+  }
+
+  // The validation is not part of any of the times above
+  if(a_results.validation_time >= 0){
+    printf("Validating the results took %.3f seconds (slowest process), not included in the kernel times.\n", a_results.validation_time);
+  }else{
+    printf("The results were not validated.\n");
+  }
+
+  return;
+
+}
+
+// Print the node bandwidths achieved with regular and streaming stores next to each other.
+// As with print_results this is only expected to be called from the root process.
+void print_store_comparison(aggregate_results regular_results, aggregate_results streaming_results, size_t array_size, int element_size, communicator node_comm){
+
+  int i;
+  double regular_bandwidth, streaming_bandwidth;
+  double size;
+  char label[MAX_FILE_NAME_LENGTH];
+
+  printf("Node Benchmark   Regular Stores   Streaming Stores   Streaming/Regular\n");
+  printf("                     (MB/s)            (MB/s)\n");
+  printf("----------------------------------------------------------------------\n");
+
+  for(i=0; i<num_kernels; i++){
+    if(!regular_results.results[i].used || !streaming_results.results[i].used){
+      continue;
+    }
+    size = (double)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * element_size * array_size * node_comm.size;
+    regular_bandwidth = (1.0E-06 * size)/regular_results.results[i].avg;
+    streaming_bandwidth = (1.0E-06 * size)/streaming_results.results[i].avg;
+    sprintf(label, "Node %s:", kernel_registry[i].name);
+    printf("%-15s%12.1f:     %12.1f:        %8.3f\n", label, regular_bandwidth, streaming_bandwidth, streaming_bandwidth/regular_bandwidth);
+  }
+
+  return;
+
+}
+
+// Gather the latency results of every node to the root process. Only the first process
+// on each node has results.
+void collect_latency_results(latency_results l_results, latency_results *all_node_latencies, communicator node_comm, communicator root_comm){
+
+  if(node_comm.rank == ROOT){
+    gather_nodes(&l_results, sizeof(latency_results), all_node_latencies, root_comm);
+  }
+
+}
+
+// Print the average, best and worst of the node latency results, with the nodes the best
+// and worst were on. As with print_results this is only expected to be called from the root
+// process.
+void print_latency_results(latency_results *all_node_latencies, size_t footprint, communicator node_comm, communicator root_comm){
+
+  double values[3];
+  double average, min, max;
+  int min_node, max_node;
+  int i, k;
+  char *labels[3] = {"Idle latency (ns):", "Loaded latency (ns):", "Loading Triad (MB/s):"};
+
+  printf("Running on %d nodes, %d processes per node, pointer chasing through %.1f KiB\n", root_comm.size, node_comm.size, footprint/1024.0);
+  printf("Measurement                 Node Average        Best Node       Worst Node   Best Location   Worst Location\n");
+  printf("---------------------------------------------------------------------------------------------------------\n");
+  for(i=0; i<3; i++){
+    // Nothing loads the node with only one process per node
+    if(i > 0 && node_comm.size == 1){
+      continue;
+    }
+    average = 0;
+    min = FLT_MAX;
+    max = 0;
+    min_node = 0;
+    max_node = 0;
+    for(k=0; k<root_comm.size; k++){
+      values[0] = all_node_latencies[k].idle_latency;
+      values[1] = all_node_latencies[k].loaded_latency;
+      values[2] = all_node_latencies[k].loaded_bandwidth;
+      average = average + values[i];
+      if(values[i] < min){
+        min = values[i];
+        min_node = k;
+      }
+      if(values[i] > max){
+        max = values[i];
+        max_node = k;
+      }
+    }
+    average = average/root_comm.size;
+    // A lower latency is better, but a higher bandwidth is
+    if(i < 2){
+      printf("%-22s%15.1f  %15.1f  %15.1f   %s   %s\n", labels[i], average, min, max, all_node_latencies[min_node].name, all_node_latencies[max_node].name);
+    }else{
+      printf("%-22s%15.1f  %15.1f  %15.1f   %s   %s\n", labels[i], average, max, min, all_node_latencies[max_node].name, all_node_latencies[min_node].name);
+    }
+  }
+
+  return;
+
+}
+
+// Print where the pages of the memory task arrays were placed, summed over all the nodes.
+// The per node placement is in the results file. Nothing is printed if the placement was
+// not recorded (i.e. without NUMA support). As with print_results this is only expected
+// to be called from the root process.
+void print_numa_placement(benchmark_results *all_node_results, communicator root_comm){
+
+  double pages[MAX_NUMA_DOMAINS];
+  double total = 0;
+  int i, k;
+
+  for(i=0; i<MAX_NUMA_DOMAINS; i++){
+    pages[i] = 0;
+    for(k=0; k<root_comm.size; k++){
+      pages[i] = pages[i] + all_node_results[k].numa_pages[i];
+    }
+    total = total + pages[i];
+  }
+  if(total == 0){
+    return;
+  }
+
+  printf("Array pages by NUMA domain:");
+  for(i=0; i<MAX_NUMA_DOMAINS; i++){
+    if(pages[i] > 0){
+      printf("  %d: %.1f%%", i, 100.0*pages[i]/total);
+    }
+  }
+  printf("\n");
+
+  return;
+
+}
+
+// Print how much of the arrays were on huge pages, over all the nodes and for the node with
+// the least. As with print_results this is only expected to be called from the root process.
+void print_page_coverage(benchmark_results *all_node_results, communicator root_comm){
+
+  double huge = 0, resident = 0;
+  double coverage, lowest = 2;
+  int lowest_node = 0;
+  int k;
+
+  for(k=0; k<root_comm.size; k++){
+    if(all_node_results[k].resident_bytes <= 0){
+      continue;
+    }
+    huge = huge + all_node_results[k].huge_page_bytes;
+    resident = resident + all_node_results[k].resident_bytes;
+    coverage = all_node_results[k].huge_page_bytes/all_node_results[k].resident_bytes;
+    if(coverage < lowest){
+      lowest = coverage;
+      lowest_node = k;
+    }
+  }
+  if(resident == 0){
+    return;
+  }
+
+  printf("Arrays allocated with %s pages, %.1f%% on huge pages (lowest node %.1f%%, %s)\n", page_mode_name(all_node_results[0].pages), 100.0*huge/resident, 100.0*lowest, all_node_results[lowest_node].name);
+
+  return;
+
+}
+
+// Set up the outlier analysis for num_nodes nodes, flagging measurements with a robust
+// z-score below -threshold. Only expected to be used on the root process.
+void initialise_outlier_results(outlier_results *outliers, int num_nodes, double threshold){
+
+  int k;
+
+  outliers->threshold = threshold;
+  outliers->num_nodes = num_nodes;
+  outliers->num_measurements = 0;
+  outliers->scores = malloc(num_nodes * sizeof(double));
+  outliers->counts = malloc(num_nodes * sizeof(int));
+  outliers->measurements = malloc((size_t)num_nodes * MAX_MEASUREMENT_NAME);
+  outliers->names = malloc((size_t)num_nodes * MPI_MAX_PROCESSOR_NAME);
+  for(k=0; k<num_nodes; k++){
+    outliers->scores[k] = 0;
+    outliers->counts[k] = 0;
+    outliers->measurements[k][0] = '\0';
+    outliers->names[k][0] = '\0';
+  }
+
+}
+
+void free_outlier_results(outlier_results *outliers){
+
+  free(outliers->scores);
+  free(outliers->counts);
+  free(outliers->measurements);
+  free(outliers->names);
+
+}
+
+static int compare_doubles(const void *a, const void *b){
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// The median of the first count values, which are sorted in place
+static double sorted_median(double *values, int count){
+
+  qsort(values, count, sizeof(double), compare_doubles);
+  if(count % 2 == 0){
+    return 0.5*(values[count/2 - 1] + values[count/2]);
+  }
+  return values[count/2];
+
+}
+
+// Score one measurement (one value per node, zero or less where a node has none) with the
+// robust z-score of each node, (value - median)/(1.4826 * MAD), where MAD is the median
+// absolute deviation from the median. Unlike the mean and standard deviation, a few slow
+// nodes hardly move the median and MAD, so they cannot hide each other. If more than half the
+// nodes have the same value the MAD is zero and the mean absolute deviation (scaled by 1.2533)
+// is used instead. The scores are negated when a lower value is better, so a negative score is
+// always a worse node, and the nodes below -threshold (and MIN_OUTLIER_DEVIATION worse than the
+// median) are flagged.
+void find_outliers(outlier_results *outliers, double *values, int higher_is_better, char *measurement){
+
+  double *deviations;
+  double centre, spread, score;
+  int count = 0;
+  int i, k;
+
+  deviations = malloc(outliers->num_nodes * sizeof(double));
+  for(k=0; k<outliers->num_nodes; k++){
+    if(values[k] > 0){
+      deviations[count] = values[k];
+      count++;
+    }
+  }
+  if(count < MIN_OUTLIER_NODES){
+    free(deviations);
+    return;
+  }
+
+  centre = sorted_median(deviations, count);
+  for(i=0; i<count; i++){
+    deviations[i] = fabs(deviations[i] - centre);
+  }
+  spread = 1.4826 * sorted_median(deviations, count);
+  if(spread == 0){
+    for(i=0; i<count; i++){
+      spread = spread + deviations[i];
+    }
+    spread = 1.2533 * spread/count;
+  }
+  free(deviations);
+  outliers->num_measurements++;
+  // Every node measured the same
+  if(spread == 0){
+    return;
+  }
+
+  for(k=0; k<outliers->num_nodes; k++){
+    if(values[k] <= 0){
+      continue;
+    }
+    score = (values[k] - centre)/spread;
+    if(!higher_is_better){
+      score = -score;
+    }
+    if(score < -outliers->threshold && fabs(values[k] - centre) >= MIN_OUTLIER_DEVIATION * centre){
+      outliers->counts[k]++;
+      if(score < outliers->scores[k]){
+        outliers->scores[k] = score;
+        snprintf(outliers->measurements[k], MAX_MEASUREMENT_NAME, "%s", measurement);
+      }
+    }
+  }
+
+}
+
+// Run the outlier analysis over the node results of a memory task, on the average and the 5th
+// percentile bandwidth of each kernel (so nodes with a slow tail are caught as well as slow
+// ones). The bandwidth is taken per process, as array_size over the time, since the bytes moved
+// per element are the same on every node but the array size may not be. type_name can be NULL
+// for the tasks that only run the default element type.
+void find_memory_outliers(outlier_results *outliers, benchmark_results *all_node_results, char *task, char *type_name){
+
+  char measurement[MAX_MEASUREMENT_NAME];
+  double *values;
+  double time;
+  int i, k;
+
+  values = malloc(outliers->num_nodes * sizeof(double));
+  for(k=0; k<outliers->num_nodes; k++){
+    strcpy(outliers->names[k], all_node_results[k].name);
+  }
+
+  for(i=0; i<num_kernels; i++){
+    if(!all_node_results[0].results[i].used){
+      continue;
+    }
+    for(k=0; k<outliers->num_nodes; k++){
+      time = all_node_results[k].results[i].avg;
+      values[k] = (time > 0) ? all_node_results[k].array_size/time : 0;
+    }
+    snprintf(measurement, MAX_MEASUREMENT_NAME, "%s%s%s %s average", type_name ? type_name : "", type_name ? " " : "", task, kernel_registry[i].name);
+    find_outliers(outliers, values, 1, measurement);
+    for(k=0; k<outliers->num_nodes; k++){
+      time = all_node_results[k].results[i].percentiles[0];
+      values[k] = (time > 0) ? all_node_results[k].array_size/time : 0;
+    }
+    snprintf(measurement, MAX_MEASUREMENT_NAME, "%s%s%s %s p%d", type_name ? type_name : "", type_name ? " " : "", task, kernel_registry[i].name, bandwidth_percentiles[0]);
+    find_outliers(outliers, values, 1, measurement);
+  }
+
+  free(values);
+
+}
+
+// Run the outlier analysis over the latency task results: the idle and loaded latency (where
+// lower is better) and the bandwidth of the loading Triad.
+void find_latency_outliers(outlier_results *outliers, latency_results *all_node_latencies, communicator node_comm){
+
+  double *values;
+  int k;
+
+  values = malloc(outliers->num_nodes * sizeof(double));
+  for(k=0; k<outliers->num_nodes; k++){
+    strcpy(outliers->names[k], all_node_latencies[k].name);
+    values[k] = all_node_latencies[k].idle_latency;
+  }
+  find_outliers(outliers, values, 0, "idle latency");
+
+  // Nothing loads the node with only one process per node
+  if(node_comm.size > 1){
+    for(k=0; k<outliers->num_nodes; k++){
+      values[k] = all_node_latencies[k].loaded_latency;
+    }
+    find_outliers(outliers, values, 0, "loaded latency");
+    for(k=0; k<outliers->num_nodes; k++){
+      values[k] = all_node_latencies[k].loaded_bandwidth;
+    }
+    find_outliers(outliers, values, 1, "loading Triad bandwidth");
+  }
+
+  free(values);
+
+}
+
+typedef struct ranked_node {
+  double score;
+  int node;
+} ranked_node;
+
+static int compare_ranked_nodes(const void *a, const void *b){
+  return compare_doubles(&((const ranked_node *)a)->score, &((const ranked_node *)b)->score);
+}
+
+// Print the nodes flagged by the outlier analysis, worst first. If exclusion_file is not NULL
+// the host names of the flagged nodes are written to it, one per line and worst first, for a
+// scheduler's exclude list. Anything after a colon in a node name (added with -N socket or numa)
+// is dropped, so a host is listed once however many of its parts were flagged. The file is
+// written even when no nodes were flagged, so an old list is never left behind. Returns the
+// number of nodes flagged. Only expected to be called from the root process.
+int report_outliers(outlier_results *outliers, char *exclusion_file){
+
+  ranked_node *ranked;
+  char (*hosts)[MPI_MAX_PROCESSOR_NAME];
+  int num_flagged = 0, num_hosts = 0;
+  int i, k;
+  char *colon;
+  FILE *fp;
+
+  ranked = malloc(outliers->num_nodes * sizeof(ranked_node));
+  for(k=0; k<outliers->num_nodes; k++){
+    if(outliers->counts[k] > 0){
+      ranked[num_flagged].score = outliers->scores[k];
+      ranked[num_flagged].node = k;
+      num_flagged++;
+    }
+  }
+  qsort(ranked, num_flagged, sizeof(ranked_node), compare_ranked_nodes);
+
+  if(outliers->num_measurements == 0){
+    if(exclusion_file != NULL){
+      printf("Outlier analysis skipped, it needs results from at least %d nodes\n", MIN_OUTLIER_NODES);
+    }
+  }else if(num_flagged == 0){
+    printf("Outlier analysis: no anomalous nodes over %d measurements (robust z-score threshold %.1f)\n", outliers->num_measurements, outliers->threshold);
+  }else{
+    printf("Outlier analysis: %d anomalous node(s) over %d measurements (robust z-score threshold %.1f)\n", num_flagged, outliers->num_measurements, outliers->threshold);
+    printf("Rank  Node                              Worst z-score  Flagged  Worst measurement\n");
+    printf("------------------------------------------------------------------------------------------\n");
+    for(i=0; i<num_flagged; i++){
+      k = ranked[i].node;
+      printf("%4d  %-32s  %13.1f  %7d  %s\n", i+1, outliers->names[k], outliers->scores[k], outliers->counts[k], outliers->measurements[k]);
+    }
+  }
+
+  if(exclusion_file != NULL){
+    fp = fopen(exclusion_file, "w");
+    if(fp == NULL){
+      printf("Warning: could not open %s to write the excluded nodes.\n", exclusion_file);
+    }else{
+      hosts = malloc((size_t)(num_flagged + 1) * MPI_MAX_PROCESSOR_NAME);
+      for(i=0; i<num_flagged; i++){
+        strcpy(hosts[num_hosts], outliers->names[ranked[i].node]);
+        colon = strchr(hosts[num_hosts], ':');
+        if(colon != NULL){
+          *colon = '\0';
+        }
+        for(k=0; k<num_hosts; k++){
+          if(strcmp(hosts[k], hosts[num_hosts]) == 0){
+            break;
+          }
+        }
+        if(k == num_hosts){
+          fprintf(fp, "%s\n", hosts[num_hosts]);
+          num_hosts++;
+        }
+      }
+      fclose(fp);
+      free(hosts);
+      printf("%d node(s) written to the exclusion list %s\n", num_hosts, exclusion_file);
+    }
+  }
+
+  free(ranked);
+
+  return num_flagged;
+
+}
+
+// Save to file node results. The intention is that this will only
+// be called from the root process as the overall design is that
+// only the root process (the process which has ROOT rank) will
+// have this data.
+void save_results(char *filename, benchmark_results *all_node_results, size_t array_size, data_type *type, communicator world_comm, communicator node_comm, communicator root_comm){
+
+  FILE *fp;
+  mxml_node_t *tree;
+  mxml_node_t *xml; 
+  mxml_node_t *node;
+  mxml_node_t *hardware;
+  mxml_node_t *experiment;
+  mxml_node_t *results;
+  mxml_node_t *result;
+  mxml_node_t *individual_result;
+  mxml_node_t *placement;
+
+  int i, j, k, omp_num_threads;
+  long size;
+  double node_bytes;
+  char element_name[MAX_FILE_NAME_LENGTH];
+  char *p;
+
+#pragma omp parallel default(shared)
+  {
+    omp_num_threads = omp_get_num_threads();
+  }
+
+  xml = mxmlNewXML("1.0");
+  tree = mxmlNewElement(xml, "stream_run");
+
+  experiment = mxmlNewElement(tree, "experiment");
+  mxmlNewText(experiment, 0, filename);
+
+  hardware = mxmlNewElement(tree, "configuration");
+  node = mxmlNewElement(hardware, "processes_per_node");
+  mxmlNewInteger(node, node_comm.size);
+  node = mxmlNewElement(hardware, "threads_per_process");
+  mxmlNewInteger(node, omp_num_threads);
+  node =  mxmlNewElement(hardware, "number_of_nodes");
+  mxmlNewInteger(node, root_comm.size);
+  node = mxmlNewElement(hardware, "element_type");
+  mxmlNewText(node, 0, type->name);
+  node = mxmlNewElement(hardware, "element_size");
+  mxmlNewInteger(node, type->size);
+  node = mxmlNewElement(hardware, "array_size");
+  mxmlNewReal(node, (double)array_size);
+  // The size elements are named after the kernel in lower case (i.e. copy_size)
+  for(i=0; i<num_kernels; i++){
+    if(!all_node_results[0].results[i].used){
+      continue;
+    }
+    size = (long)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * type->size * array_size;
+    sprintf(element_name, "%s_size", kernel_registry[i].name);
+    for(p=element_name; *p; p++){
+      *p = tolower(*p);
+    }
+    node =  mxmlNewElement(hardware, element_name);
+    mxmlNewReal(node, (float)size);
+  }
+
+  results = mxmlNewElement(tree, "results");
+  for(k=0; k<root_comm.size; k++){
+    result = mxmlNewElement(results, "node");
+    node = mxmlNewElement(result, "name");
+    mxmlNewText(node, 0, all_node_results[k].name);
+    node = mxmlNewElement(result, "array_size");
+    mxmlNewReal(node, (double)all_node_results[k].array_size);
+    node = mxmlNewElement(result, "repeats");
+    mxmlNewInteger(node, all_node_results[k].repeats);
+    // Only present when the results were validated
+    if(all_node_results[k].validation_time >= 0){
+      node = mxmlNewElement(result, "validation_time");
+      mxmlNewReal(node, all_node_results[k].validation_time);
+    }
+    // The sampled pages of the arrays on each NUMA domain, if the placement was recorded
+    placement = NULL;
+    for(i=0; i<MAX_NUMA_DOMAINS; i++){
+      if(all_node_results[k].numa_pages[i] > 0){
+        if(placement == NULL){
+          placement = mxmlNewElement(result, "numa_placement");
+        }
+        sprintf(element_name, "domain%d", i);
+        node = mxmlNewElement(placement, element_name);
+        mxmlNewReal(node, all_node_results[k].numa_pages[i]);
+      }
+    }
+    // The pages used for the arrays, and how much of them was resident on huge pages
+    if(all_node_results[k].resident_bytes > 0){
+      placement = mxmlNewElement(result, "huge_pages");
+      node = mxmlNewElement(placement, "mode");
+      mxmlNewText(node, 0, page_mode_name(all_node_results[k].pages));
+      node = mxmlNewElement(placement, "huge_page_bytes");
+      mxmlNewReal(node, all_node_results[k].huge_page_bytes);
+      node = mxmlNewElement(placement, "resident_bytes");
+      mxmlNewReal(node, all_node_results[k].resident_bytes);
+    }
+    // The cost of a parallel region and of a barrier on the node, in seconds
+    if(all_node_results[k].fork_join_time > 0){
+      placement = mxmlNewElement(result, "openmp_overheads");
+      node = mxmlNewElement(placement, "fork_join");
+      mxmlNewReal(node, all_node_results[k].fork_join_time);
+      node = mxmlNewElement(placement, "team_barrier");
+      mxmlNewReal(node, all_node_results[k].team_barrier_time);
+    }
+    for(i=0; i<num_kernels; i++){
+      if(!all_node_results[k].results[i].used){
+        continue;
+      }
+      node = mxmlNewElement(result, kernel_registry[i].name);
+      individual_result = mxmlNewElement(node, "Average");
+      mxmlNewReal(individual_result, all_node_results[k].results[i].avg);
+      individual_result = mxmlNewElement(node, "Minimum");
+      mxmlNewReal(individual_result, all_node_results[k].results[i].min);
+      individual_result = mxmlNewElement(node, "Maximum");
+      mxmlNewReal(individual_result, all_node_results[k].results[i].max);
+      // Only present when the threads were timed
+      if(all_node_results[k].results[i].imbalance > 0){
+        individual_result = mxmlNewElement(node, "Imbalance");
+        mxmlNewReal(individual_result, all_node_results[k].results[i].imbalance);
+        individual_result = mxmlNewElement(node, "Worst_imbalance");
+        mxmlNewReal(individual_result, all_node_results[k].results[i].max_imbalance);
+      }
+      // Only present when there were enough repeats to estimate it
+      if(all_node_results[k].results[i].confidence > 0){
+        individual_result = mxmlNewElement(node, "Confidence");
+        mxmlNewReal(individual_result, all_node_results[k].results[i].confidence);
+      }
+      // The node bandwidth percentiles over the processes and repeats of the node, in MB/s
+      node_bytes = (double)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * type->size * all_node_results[k].array_size * node_comm.size;
+      for(j=0; j<NUM_PERCENTILES; j++){
+        if(all_node_results[k].results[i].percentiles[j] > 0){
+          sprintf(element_name, "Bandwidth_p%d", bandwidth_percentiles[j]);
+          individual_result = mxmlNewElement(node, element_name);
+          mxmlNewReal(individual_result, (1.0E-06 * node_bytes)/all_node_results[k].results[i].percentiles[j]);
+        }
+      }
+    }
+  }
+  
+
+  fp = fopen(filename, "w");
+  mxmlSaveFile(xml, fp, MXML_NO_CALLBACK);
+  fclose(fp);
+  
+  mxmlDelete(xml);
+
+  return;
+
+}
+
+// Save to file the per node results of a sweep, giving a bandwidth against array size
+// (or against offset, if the offsets are given) curve for each node. As with save_results
+// this is only expected to be called from the root process.
+void save_sweep_results(char *filename, benchmark_results **sweep_node_results, size_t *sweep_sizes, size_t *sweep_offsets, int num_points, data_type *type, communicator world_comm, communicator node_comm, communicator root_comm){
 
   FILE *fp;
   mxml_node_t *tree;
-  mxml_node_t *xml; 
+  mxml_node_t *xml;
   mxml_node_t *node;
   mxml_node_t *hardware;
   mxml_node_t *experiment;
   mxml_node_t *results;
   mxml_node_t *result;
+  mxml_node_t *point_result;
   mxml_node_t *individual_result;
 
-  int k, omp_num_threads;
-  long copy_size = 2 * sizeof(STREAM_TYPE) * array_size;
-  long scale_size = 2 * sizeof(STREAM_TYPE) * array_size;
-  long add_size = 3 * sizeof(STREAM_TYPE) * array_size;
-  long triad_size = 3 * sizeof(STREAM_TYPE) * array_size;
+  int i, k, point, omp_num_threads;
+  long size;
+  char element_name[MAX_FILE_NAME_LENGTH];
+  char *p;
 
 #pragma omp parallel default(shared)
   {
@@ -624,7 +3021,7 @@ void save_results(char *filename, benchmark_results *all_node_results, size_t ar
   }
 
   xml = mxmlNewXML("1.0");
-  tree = mxmlNewElement(xml, "stream_run");
+  tree = mxmlNewElement(xml, "stream_sweep");
 
   experiment = mxmlNewElement(tree, "experiment");
   mxmlNewText(experiment, 0, filename);
@@ -636,57 +3033,428 @@ void save_results(char *filename, benchmark_results *all_node_results, size_t ar
   mxmlNewInteger(node, omp_num_threads);
   node =  mxmlNewElement(hardware, "number_of_nodes");
   mxmlNewInteger(node, root_comm.size);
-  node =  mxmlNewElement(hardware, "copy_size");
-  mxmlNewReal(node, (float)copy_size);
-  node =  mxmlNewElement(hardware, "scale_size");
-  mxmlNewReal(node, (float)scale_size);
-  node =  mxmlNewElement(hardware, "add_size");
-  mxmlNewReal(node, (float)add_size);
-  node =  mxmlNewElement(hardware, "triad_size");
-  mxmlNewReal(node, (float)triad_size);
+  node = mxmlNewElement(hardware, "element_type");
+  mxmlNewText(node, 0, type->name);
+  node = mxmlNewElement(hardware, "element_size");
+  mxmlNewInteger(node, type->size);
+  node = mxmlNewElement(hardware, "sweep_points");
+  mxmlNewInteger(node, num_points);
+
+  results = mxmlNewElement(tree, "results");
+  for(k=0; k<root_comm.size; k++){
+    result = mxmlNewElement(results, "node");
+    node = mxmlNewElement(result, "name");
+    mxmlNewText(node, 0, sweep_node_results[0][k].name);
+    for(point=0; point<num_points; point++){
+      point_result = mxmlNewElement(result, "point");
+      node = mxmlNewElement(point_result, "array_size");
+      mxmlNewReal(node, (double)sweep_sizes[point]);
+      // Only offset sweeps step the offset between the arrays
+      if(sweep_offsets != NULL){
+        node = mxmlNewElement(point_result, "offset");
+        mxmlNewReal(node, (double)sweep_offsets[point]);
+      }
+      // As in save_results the size elements are named after the kernel in lower case
+      for(i=0; i<num_kernels; i++){
+        if(!sweep_node_results[point][k].results[i].used){
+          continue;
+        }
+        size = (long)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * type->size * sweep_sizes[point];
+        sprintf(element_name, "%s_size", kernel_registry[i].name);
+        for(p=element_name; *p; p++){
+          *p = tolower(*p);
+        }
+        node = mxmlNewElement(point_result, element_name);
+        mxmlNewReal(node, (float)size);
+      }
+      for(i=0; i<num_kernels; i++){
+        if(!sweep_node_results[point][k].results[i].used){
+          continue;
+        }
+        node = mxmlNewElement(point_result, kernel_registry[i].name);
+        individual_result = mxmlNewElement(node, "Average");
+        mxmlNewReal(individual_result, sweep_node_results[point][k].results[i].avg);
+        individual_result = mxmlNewElement(node, "Minimum");
+        mxmlNewReal(individual_result, sweep_node_results[point][k].results[i].min);
+        individual_result = mxmlNewElement(node, "Maximum");
+        mxmlNewReal(individual_result, sweep_node_results[point][k].results[i].max);
+      }
+    }
+  }
+
+  fp = fopen(filename, "w");
+  mxmlSaveFile(xml, fp, MXML_NO_CALLBACK);
+  fclose(fp);
+
+  mxmlDelete(xml);
+
+  return;
+
+}
+
+// Save to file the per node results of a stream count sweep, giving the time taken for
+// each number of arrays read. As with save_results this is only expected to be called
+// from the root process.
+void save_stream_count_results(char *filename, benchmark_results **sweep_node_results, int *sweep_reads, int num_points, int writes, data_type *type, communicator world_comm, communicator node_comm, communicator root_comm){
 
+  FILE *fp;
+  mxml_node_t *tree;
+  mxml_node_t *xml;
+  mxml_node_t *node;
+  mxml_node_t *hardware;
+  mxml_node_t *experiment;
+  mxml_node_t *results;
+  mxml_node_t *result;
+  mxml_node_t *point_result;
+
+  int k, point, omp_num_threads;
+
+#pragma omp parallel default(shared)
+  {
+    omp_num_threads = omp_get_num_threads();
+  }
+
+  xml = mxmlNewXML("1.0");
+  tree = mxmlNewElement(xml, "stream_count_sweep");
+
+  experiment = mxmlNewElement(tree, "experiment");
+  mxmlNewText(experiment, 0, filename);
 
+  hardware = mxmlNewElement(tree, "configuration");
+  node = mxmlNewElement(hardware, "processes_per_node");
+  mxmlNewInteger(node, node_comm.size);
+  node = mxmlNewElement(hardware, "threads_per_process");
+  mxmlNewInteger(node, omp_num_threads);
+  node =  mxmlNewElement(hardware, "number_of_nodes");
+  mxmlNewInteger(node, root_comm.size);
+  node = mxmlNewElement(hardware, "element_type");
+  mxmlNewText(node, 0, type->name);
+  node = mxmlNewElement(hardware, "element_size");
+  mxmlNewInteger(node, type->size);
+  node = mxmlNewElement(hardware, "arrays_written");
+  mxmlNewInteger(node, writes);
+  node = mxmlNewElement(hardware, "sweep_points");
+  mxmlNewInteger(node, num_points);
 
   results = mxmlNewElement(tree, "results");
   for(k=0; k<root_comm.size; k++){
     result = mxmlNewElement(results, "node");
     node = mxmlNewElement(result, "name");
-    mxmlNewText(node, 0, all_node_results[k].name);
-    node = mxmlNewElement(result, "Copy");
-    individual_result = mxmlNewElement(node, "Average");
-    mxmlNewReal(individual_result, all_node_results[k].Copy.avg);
-    individual_result = mxmlNewElement(node, "Minimum");
-    mxmlNewReal(individual_result, all_node_results[k].Copy.min);
-    individual_result = mxmlNewElement(node, "Maximum");
-    mxmlNewReal(individual_result, all_node_results[k].Copy.max);
-    node = mxmlNewElement(result, "Scale");
-    individual_result = mxmlNewElement(node, "Average");
-    mxmlNewReal(individual_result, all_node_results[k].Scale.avg);
-    individual_result = mxmlNewElement(node, "Minimum");
-    mxmlNewReal(individual_result, all_node_results[k].Scale.min);
-    individual_result = mxmlNewElement(node, "Maximum");
-    mxmlNewReal(individual_result, all_node_results[k].Scale.max);
-    node = mxmlNewElement(result, "Add");
-    individual_result = mxmlNewElement(node, "Average");
-    mxmlNewReal(individual_result, all_node_results[k].Add.avg);
-    individual_result = mxmlNewElement(node, "Minimum");
-    mxmlNewReal(individual_result, all_node_results[k].Add.min);
-    individual_result = mxmlNewElement(node, "Maximum");
-    mxmlNewReal(individual_result, all_node_results[k].Add.max);
-    node = mxmlNewElement(result, "Triad");
-    individual_result = mxmlNewElement(node, "Average");
-    mxmlNewReal(individual_result, all_node_results[k].Triad.avg);
-    individual_result = mxmlNewElement(node, "Minimum");
-    mxmlNewReal(individual_result, all_node_results[k].Triad.min);
-    individual_result = mxmlNewElement(node, "Maximum");
-    mxmlNewReal(individual_result, all_node_results[k].Triad.max);
+    mxmlNewText(node, 0, sweep_node_results[0][k].name);
+    for(point=0; point<num_points; point++){
+      point_result = mxmlNewElement(result, "point");
+      node = mxmlNewElement(point_result, "arrays_read");
+      mxmlNewInteger(node, sweep_reads[point]);
+      node = mxmlNewElement(point_result, "array_size");
+      mxmlNewReal(node, (double)sweep_node_results[point][k].array_size);
+      node = mxmlNewElement(point_result, "Average");
+      mxmlNewReal(node, sweep_node_results[point][k].results[streams].avg);
+      node = mxmlNewElement(point_result, "Minimum");
+      mxmlNewReal(node, sweep_node_results[point][k].results[streams].min);
+      node = mxmlNewElement(point_result, "Maximum");
+      mxmlNewReal(node, sweep_node_results[point][k].results[streams].max);
+    }
   }
-  
 
   fp = fopen(filename, "w");
   mxmlSaveFile(xml, fp, MXML_NO_CALLBACK);
   fclose(fp);
-  
+
+  mxmlDelete(xml);
+
+  return;
+
+}
+
+// Save to file the CPU domain to memory domain bandwidth matrix of each node. As with
+// save_results this is only expected to be called from the root process.
+void save_numa_matrix(char *filename, double *all_node_matrices, char (*node_names)[MPI_MAX_PROCESSOR_NAME], int num_domains, data_type *type, communicator node_comm, communicator root_comm){
+
+  FILE *fp;
+  mxml_node_t *tree;
+  mxml_node_t *xml;
+  mxml_node_t *node;
+  mxml_node_t *hardware;
+  mxml_node_t *experiment;
+  mxml_node_t *results;
+  mxml_node_t *result;
+  mxml_node_t *kernel_result;
+  mxml_node_t *row;
+
+  int i, k, domain, mem_domain, omp_num_threads;
+  int matrix_size = num_kernels * num_domains * num_domains;
+  char element_name[MAX_FILE_NAME_LENGTH];
+
+#pragma omp parallel default(shared)
+  {
+    omp_num_threads = omp_get_num_threads();
+  }
+
+  xml = mxmlNewXML("1.0");
+  tree = mxmlNewElement(xml, "stream_numa_matrix");
+
+  experiment = mxmlNewElement(tree, "experiment");
+  mxmlNewText(experiment, 0, filename);
+
+  hardware = mxmlNewElement(tree, "configuration");
+  node = mxmlNewElement(hardware, "processes_per_node");
+  mxmlNewInteger(node, node_comm.size);
+  node = mxmlNewElement(hardware, "threads_per_process");
+  mxmlNewInteger(node, omp_num_threads);
+  node =  mxmlNewElement(hardware, "number_of_nodes");
+  mxmlNewInteger(node, root_comm.size);
+  node = mxmlNewElement(hardware, "element_type");
+  mxmlNewText(node, 0, type->name);
+  node = mxmlNewElement(hardware, "element_size");
+  mxmlNewInteger(node, type->size);
+  node = mxmlNewElement(hardware, "numa_domains");
+  mxmlNewInteger(node, num_domains);
+
+  // Bandwidths are in MB/s, with a row per CPU domain and a column per memory domain. Pairs
+  // that could not be measured (no processes or no memory in the domain) are 0.
+  results = mxmlNewElement(tree, "results");
+  for(k=0; k<root_comm.size; k++){
+    result = mxmlNewElement(results, "node");
+    node = mxmlNewElement(result, "name");
+    mxmlNewText(node, 0, node_names[k]);
+    for(i=0; i<num_kernels; i++){
+      if(!kernel_registry[i].enabled){
+        continue;
+      }
+      kernel_result = mxmlNewElement(result, kernel_registry[i].name);
+      for(domain=0; domain<num_domains; domain++){
+        sprintf(element_name, "cpu_domain%d", domain);
+        row = mxmlNewElement(kernel_result, element_name);
+        for(mem_domain=0; mem_domain<num_domains; mem_domain++){
+          sprintf(element_name, "memory_domain%d", mem_domain);
+          node = mxmlNewElement(row, element_name);
+          mxmlNewReal(node, all_node_matrices[k*matrix_size + (i*num_domains + domain)*num_domains + mem_domain]);
+        }
+      }
+    }
+  }
+
+  fp = fopen(filename, "w");
+  mxmlSaveFile(xml, fp, MXML_NO_CALLBACK);
+  fclose(fp);
+
+  mxmlDelete(xml);
+
+  return;
+
+}
+
+// Gather the interference results of every node on the root process. The bandwidths of all
+// the nodes are gathered into a single block, freed with the bandwidths of the first node.
+void collect_interference_results(interference_results i_results, interference_results *all_node_interference, communicator node_comm, communicator root_comm){
+
+  double *all_bandwidths = NULL;
+  int count = i_results.num_points * num_kernels;
+  int k;
+
+  if(node_comm.rank == ROOT){
+    if(root_comm.rank == ROOT){
+      all_bandwidths = malloc((size_t)root_comm.size * count * sizeof(double));
+    }
+    gather_nodes(&i_results, sizeof(interference_results), all_node_interference, root_comm);
+    gather_nodes(i_results.bandwidths, count * sizeof(double), all_bandwidths, root_comm);
+    if(root_comm.rank == ROOT){
+      for(k=0; k<root_comm.size; k++){
+        all_node_interference[k].bandwidths = &all_bandwidths[k*count];
+      }
+    }
+  }
+
+}
+
+// Print the node bandwidth of each kernel at each load point, averaged over the nodes, along
+// with the fraction of the unloaded bandwidth that was left and the node that lost most
+void print_interference_results(interference_results *all_node_interference, int generators, communicator node_comm, communicator root_comm){
+
+  double peak, target, generated, average, retained, worst;
+  double baseline;
+  int worst_node;
+  int i, k, point;
+  int num_points = all_node_interference[0].num_points;
+
+  peak = 0;
+  for(k=0; k<root_comm.size; k++){
+    peak = peak + all_node_interference[k].peak_bandwidth;
+  }
+  peak = peak/root_comm.size;
+  printf("Running on %d nodes, %d generator(s) and %d measuring process(es) per node\n", root_comm.size, generators, node_comm.size - generators);
+  printf("Generator peak Triad bandwidth (node average): %.1f MB/s\n", peak);
+  printf("Kernel          Load   Target Traffic   Generated Traffic   Node Bandwidth   Of Idle   Worst Of Idle   Worst Location\n");
+  printf("                 (%%)       (MB/s)            (MB/s)             (MB/s)        (%%)         (%%)\n");
+  printf("---------------------------------------------------------------------------------------------------------------------\n");
+  for(i=0; i<num_kernels; i++){
+    if(!kernel_registry[i].enabled){
+      continue;
+    }
+    for(point=0; point<num_points; point++){
+      target = (all_node_interference[0].fractions[point] >= 100) ? peak : peak*all_node_interference[0].fractions[point]/100.0;
+      generated = 0;
+      average = 0;
+      retained = 0;
+      worst = FLT_MAX;
+      worst_node = 0;
+      for(k=0; k<root_comm.size; k++){
+        generated = generated + all_node_interference[k].generated[point];
+        average = average + all_node_interference[k].bandwidths[point*num_kernels + i];
+        baseline = all_node_interference[k].bandwidths[i];
+        if(baseline > 0){
+          retained = retained + all_node_interference[k].bandwidths[point*num_kernels + i]/baseline;
+          if(all_node_interference[k].bandwidths[point*num_kernels + i]/baseline < worst){
+            worst = all_node_interference[k].bandwidths[point*num_kernels + i]/baseline;
+            worst_node = k;
+          }
+        }
+      }
+      printf("%-14s %5d %16.1f %19.1f %18.1f %9.1f %15.1f   %s\n", (point == 0) ? kernel_registry[i].name : "", all_node_interference[0].fractions[point], target, generated/root_comm.size, average/root_comm.size, 100.0*retained/root_comm.size, 100.0*worst, all_node_interference[worst_node].name);
+    }
+  }
+
+  return;
+
+}
+
+// Save the interference curve of each node to file. As with save_results this is only expected
+// to be called from the root process.
+void save_interference_results(char *filename, interference_results *all_node_interference, int generators, size_t array_size, data_type *type, communicator node_comm, communicator root_comm){
+
+  FILE *fp;
+  mxml_node_t *tree;
+  mxml_node_t *xml;
+  mxml_node_t *node;
+  mxml_node_t *hardware;
+  mxml_node_t *experiment;
+  mxml_node_t *results;
+  mxml_node_t *result;
+  mxml_node_t *point_result;
+
+  int i, k, point, omp_num_threads;
+
+#pragma omp parallel default(shared)
+  {
+    omp_num_threads = omp_get_num_threads();
+  }
+
+  xml = mxmlNewXML("1.0");
+  tree = mxmlNewElement(xml, "stream_interference");
+
+  experiment = mxmlNewElement(tree, "experiment");
+  mxmlNewText(experiment, 0, filename);
+
+  hardware = mxmlNewElement(tree, "configuration");
+  node = mxmlNewElement(hardware, "processes_per_node");
+  mxmlNewInteger(node, node_comm.size);
+  node = mxmlNewElement(hardware, "generators_per_node");
+  mxmlNewInteger(node, generators);
+  node = mxmlNewElement(hardware, "threads_per_process");
+  mxmlNewInteger(node, omp_num_threads);
+  node =  mxmlNewElement(hardware, "number_of_nodes");
+  mxmlNewInteger(node, root_comm.size);
+  node = mxmlNewElement(hardware, "element_type");
+  mxmlNewText(node, 0, type->name);
+  node = mxmlNewElement(hardware, "element_size");
+  mxmlNewInteger(node, type->size);
+  node = mxmlNewElement(hardware, "array_size");
+  mxmlNewReal(node, (double)array_size);
+
+  // All the bandwidths are node bandwidths in MB/s
+  results = mxmlNewElement(tree, "results");
+  for(k=0; k<root_comm.size; k++){
+    result = mxmlNewElement(results, "node");
+    node = mxmlNewElement(result, "name");
+    mxmlNewText(node, 0, all_node_interference[k].name);
+    node = mxmlNewElement(result, "peak_bandwidth");
+    mxmlNewReal(node, all_node_interference[k].peak_bandwidth);
+    for(point=0; point<all_node_interference[k].num_points; point++){
+      point_result = mxmlNewElement(result, "point");
+      node = mxmlNewElement(point_result, "load");
+      mxmlNewInteger(node, all_node_interference[k].fractions[point]);
+      node = mxmlNewElement(point_result, "generated");
+      mxmlNewReal(node, all_node_interference[k].generated[point]);
+      for(i=0; i<num_kernels; i++){
+        if(!kernel_registry[i].enabled){
+          continue;
+        }
+        node = mxmlNewElement(point_result, kernel_registry[i].name);
+        mxmlNewReal(node, all_node_interference[k].bandwidths[point*num_kernels + i]);
+      }
+    }
+  }
+
+  fp = fopen(filename, "w");
+  mxmlSaveFile(xml, fp, MXML_NO_CALLBACK);
+  fclose(fp);
+
+  mxmlDelete(xml);
+
+  return;
+
+}
+
+// Save to file the latency results of each node. As with save_results this is only
+// expected to be called from the root process.
+void save_latency_results(char *filename, latency_results *all_node_latencies, size_t footprint, communicator node_comm, communicator root_comm){
+
+  FILE *fp;
+  mxml_node_t *tree;
+  mxml_node_t *xml;
+  mxml_node_t *node;
+  mxml_node_t *hardware;
+  mxml_node_t *experiment;
+  mxml_node_t *results;
+  mxml_node_t *result;
+
+  int k, omp_num_threads;
+
+#pragma omp parallel default(shared)
+  {
+    omp_num_threads = omp_get_num_threads();
+  }
+
+  xml = mxmlNewXML("1.0");
+  tree = mxmlNewElement(xml, "stream_latency");
+
+  experiment = mxmlNewElement(tree, "experiment");
+  mxmlNewText(experiment, 0, filename);
+
+  hardware = mxmlNewElement(tree, "configuration");
+  node = mxmlNewElement(hardware, "processes_per_node");
+  mxmlNewInteger(node, node_comm.size);
+  node = mxmlNewElement(hardware, "threads_per_process");
+  mxmlNewInteger(node, omp_num_threads);
+  node =  mxmlNewElement(hardware, "number_of_nodes");
+  mxmlNewInteger(node, root_comm.size);
+  node = mxmlNewElement(hardware, "footprint");
+  mxmlNewReal(node, (double)footprint);
+
+  // Latencies are in nanoseconds per load and the bandwidth is in MB/s
+  results = mxmlNewElement(tree, "results");
+  for(k=0; k<root_comm.size; k++){
+    result = mxmlNewElement(results, "node");
+    node = mxmlNewElement(result, "name");
+    mxmlNewText(node, 0, all_node_latencies[k].name);
+    node = mxmlNewElement(result, "idle_latency");
+    mxmlNewReal(node, all_node_latencies[k].idle_latency);
+    node = mxmlNewElement(result, "idle_min");
+    mxmlNewReal(node, all_node_latencies[k].idle_min);
+    if(node_comm.size > 1){
+      node = mxmlNewElement(result, "loaded_latency");
+      mxmlNewReal(node, all_node_latencies[k].loaded_latency);
+      node = mxmlNewElement(result, "loaded_min");
+      mxmlNewReal(node, all_node_latencies[k].loaded_min);
+      node = mxmlNewElement(result, "loaded_bandwidth");
+      mxmlNewReal(node, all_node_latencies[k].loaded_bandwidth);
+    }
+  }
+
+  fp = fopen(filename, "w");
+  mxmlSaveFile(xml, fp, MXML_NO_CALLBACK);
+  fclose(fp);
+
   mxmlDelete(xml);
 
   return;
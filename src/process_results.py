@@ -98,10 +98,11 @@ def main():
     procs_per_node = 0
     threads_per_proc = 0
     nodes_used = 0
-    copy_size = 0
-    scale_size = 0
-    add_size = 0
-    triad_size = 0
+    # The data size for each kernel, keyed by the kernel name in lower case
+    sizes = {}
+    # The array size the kernel data sizes were calculated for. Nodes record their own
+    # array size as it can differ between nodes (i.e. with different cache sizes).
+    array_size = 0
 
     filename = sys.argv[1]
 
@@ -119,14 +120,13 @@ def main():
         threads_per_proc = int(threads_per_proc_element[0].firstChild.nodeValue)
         nodes_used_element = element.getElementsByTagName("number_of_nodes")
         nodes_used = int(float(nodes_used_element[0].firstChild.nodeValue))
-        nodes_used_element = element.getElementsByTagName("copy_size")
-        copy_size = int(float(nodes_used_element[0].firstChild.nodeValue))/1024
-        nodes_used_element = element.getElementsByTagName("scale_size")
-        scale_size = int(float(nodes_used_element[0].firstChild.nodeValue))/1024
-        nodes_used_element = element.getElementsByTagName("add_size")
-        add_size = int(float(nodes_used_element[0].firstChild.nodeValue))/1024
-        nodes_used_element = element.getElementsByTagName("triad_size")
-        triad_size = int(float(nodes_used_element[0].firstChild.nodeValue))/1024
+        array_size_element = element.getElementsByTagName("array_size")
+        if array_size_element:
+            array_size = float(array_size_element[0].firstChild.nodeValue)
+        # Each kernel in the results has a matching <kernel>_size element
+        for child in element.childNodes:
+            if child.nodeType == child.ELEMENT_NODE and child.tagName.endswith("_size"):
+                sizes[child.tagName[:-len("_size")]] = int(float(child.firstChild.nodeValue))/1024
 
     experiment_name = experiment_name + "_" + str(procs_per_node) + "x" + str(threads_per_proc) + "_"
 
@@ -134,27 +134,23 @@ def main():
 
     x, y = calculate_factors(nodes_used)
 
-    copy_avg = np.full([x, y], np.NaN)
-    copy_min = np.full([x, y], np.NaN)
-    copy_max = np.full([x, y], np.NaN)
-
-    scale_avg = np.full([x, y], np.NaN)
-    scale_min = np.full([x, y], np.NaN)
-    scale_max = np.full([x, y], np.NaN)
+    nodes = doc.getElementsByTagName("node")
 
-    add_avg = np.full([x, y], np.NaN)
-    add_min = np.full([x, y], np.NaN)
-    add_max = np.full([x, y], np.NaN)
+    # The kernels are the elements of a node other than its name, in the order they were run
+    kernels = [child.tagName for child in nodes[0].childNodes if child.nodeType == child.ELEMENT_NODE and child.tagName not in ("name", "array_size", "repeats", "validation_time", "numa_placement", "huge_pages", "openmp_overheads")]
 
-    triad_avg = np.full([x, y], np.NaN)
-    triad_min = np.full([x, y], np.NaN)
-    triad_max = np.full([x, y], np.NaN)
+    kernel_avg = {}
+    kernel_min = {}
+    kernel_max = {}
+    for kernel in kernels:
+        kernel_avg[kernel] = np.full([x, y], np.NaN)
+        kernel_min[kernel] = np.full([x, y], np.NaN)
+        kernel_max[kernel] = np.full([x, y], np.NaN)
 
     names = np.empty([x, y], dtype=object)
 
     i = 0
     j = 0
-    nodes = doc.getElementsByTagName("node")
     # Calculate the bandwidths from the recorded times and data sizes
     # The reason we use "Maximum" to set the min value and vice versa
     # is because the stored data are times, so the maximum runtime 
@@ -165,38 +161,19 @@ def main():
             exit()
         name = node.getElementsByTagName("name")
         names[i, j] = name[0].firstChild.nodeValue
-        copy = node.getElementsByTagName("Copy")
-        for result in copy:
-            avg = result.getElementsByTagName("Average")
-            copy_avg[i,j] = (1E-6*procs_per_node*copy_size)/float(avg[0].firstChild.nodeValue)
-            min = result.getElementsByTagName("Minimum")
-            copy_max[i,j] = (1E-6*procs_per_node*copy_size)/float(min[0].firstChild.nodeValue)
-            max = result.getElementsByTagName("Maximum")
-            copy_min[i,j] = (1E-6*procs_per_node*copy_size)/float(max[0].firstChild.nodeValue)
-        scale = node.getElementsByTagName("Scale")
-        for result in scale:
-            avg = result.getElementsByTagName("Average")
-            scale_avg[i,j] = (1E-6*procs_per_node*scale_size)/float(avg[0].firstChild.nodeValue)
-            min = result.getElementsByTagName("Minimum")
-            scale_max[i,j] = (1E-6*procs_per_node*scale_size)/float(min[0].firstChild.nodeValue)
-            max = result.getElementsByTagName("Maximum")
-            scale_min[i,j] = (1E-6*procs_per_node*scale_size)/float(max[0].firstChild.nodeValue)
-        add = node.getElementsByTagName("Add")
-        for result in add:
-            avg = result.getElementsByTagName("Average")
-            add_avg[i,j] = (1E-6*procs_per_node*add_size)/float(avg[0].firstChild.nodeValue)
-            min = result.getElementsByTagName("Minimum")
-            add_max[i,j] = (1E-6*procs_per_node*add_size)/float(min[0].firstChild.nodeValue)
-            max = result.getElementsByTagName("Maximum")
-            add_min[i,j] = (1E-6*procs_per_node*add_size)/float(max[0].firstChild.nodeValue)
-        triad = node.getElementsByTagName("Triad")
-        for result in triad:
-            avg = result.getElementsByTagName("Average")
-            triad_avg[i,j] = (1E-6*procs_per_node*triad_size)/float(avg[0].firstChild.nodeValue)
-            min = result.getElementsByTagName("Minimum")
-            triad_max[i,j] = (1E-6*procs_per_node*triad_size)/float(min[0].firstChild.nodeValue)
-            max = result.getElementsByTagName("Maximum")
-            triad_min[i,j] = (1E-6*procs_per_node*triad_size)/float(max[0].firstChild.nodeValue)
+        scaling = 1
+        node_array_size = node.getElementsByTagName("array_size")
+        if node_array_size and array_size > 0:
+            scaling = float(node_array_size[0].firstChild.nodeValue)/array_size
+        for kernel in kernels:
+            size = sizes[kernel.lower()]*scaling
+            for result in node.getElementsByTagName(kernel):
+                avg = result.getElementsByTagName("Average")
+                kernel_avg[kernel][i,j] = (1E-6*procs_per_node*size)/float(avg[0].firstChild.nodeValue)
+                min = result.getElementsByTagName("Minimum")
+                kernel_max[kernel][i,j] = (1E-6*procs_per_node*size)/float(min[0].firstChild.nodeValue)
+                max = result.getElementsByTagName("Maximum")
+                kernel_min[kernel][i,j] = (1E-6*procs_per_node*size)/float(max[0].firstChild.nodeValue)
 
         i = i + 1
         if(i == x):
@@ -205,48 +182,19 @@ def main():
 
     # Flip the arrays to make node numbering row rather than column format.
     names = names.transpose()
-    copy_avg = copy_avg.transpose()
-    copy_min = copy_min.transpose()
-    copy_max = copy_max.transpose()
-    scale_avg = scale_avg.transpose()
-    scale_min = scale_min.transpose()
-    scale_max = scale_max.transpose()
-    add_avg = add_avg.transpose()
-    add_min = add_min.transpose()
-    add_max = add_max.transpose()
-    triad_avg = triad_avg.transpose()
-    triad_min = triad_min.transpose()
-    triad_max = triad_max.transpose()
-
-    plot_graphs(copy_min, x, y, nodes_used, names, "STREAM Copy Average", experiment_name, "copy_avg.png", dpi_value)
-    
-    plot_graphs(copy_min, x, y, nodes_used, names, "STREAM Copy Minimum", experiment_name, "copy_min.png", dpi_value)
-
-    plot_graphs(copy_max, x, y, nodes_used, names, "STREAM Copy Maximum", experiment_name, "copy_max.png", dpi_value)
-    
-    replace_nans(scale_avg, scale_min, scale_max)
-    
-    plot_graphs(scale_avg, x, y, nodes_used, names, "STREAM Scale Average", experiment_name, "scale_avg.png", dpi_value)
-
-    plot_graphs(scale_min, x, y, nodes_used, names, "STREAM Scale Minimum", experiment_name, "scale_min.png", dpi_value)
-    
-    plot_graphs(scale_max, x, y, nodes_used, names, "STREAM Scale Maximum", experiment_name, "scale_max.png", dpi_value)
-    
-    replace_nans(add_avg, add_min, add_max)
-
-    plot_graphs(add_avg, x, y, nodes_used, names, "STREAM Add Average", experiment_name, "add_avg.png", dpi_value)
-    
-    plot_graphs(add_min, x, y, nodes_used, names, "STREAM Add Minimum", experiment_name, "add_min.png", dpi_value)
-    
-    plot_graphs(add_max, x, y, nodes_used, names, "STREAM Add Maximum", experiment_name, "add_max.png", dpi_value)
-
-    replace_nans(triad_avg, triad_min, triad_max)    
-
-    plot_graphs(triad_avg, x, y, nodes_used, names, "STREAM Triad Average", experiment_name, "triad_avg.png", dpi_value)
-
-    plot_graphs(triad_min, x, y, nodes_used, names, "STREAM Triad Minimum", experiment_name, "triad_min.png", dpi_value)
-    
-    plot_graphs(triad_max, x, y, nodes_used, names, "STREAM Triad Maximum", experiment_name, "triad_max.png", dpi_value)
+    for kernel in kernels:
+        kernel_avg[kernel] = kernel_avg[kernel].transpose()
+        kernel_min[kernel] = kernel_min[kernel].transpose()
+        kernel_max[kernel] = kernel_max[kernel].transpose()
+
+    for kernel in kernels:
+        replace_nans(kernel_avg[kernel], kernel_min[kernel], kernel_max[kernel])
+
+        plot_graphs(kernel_avg[kernel], x, y, nodes_used, names, "STREAM " + kernel + " Average", experiment_name, kernel.lower() + "_avg.png", dpi_value)
+
+        plot_graphs(kernel_min[kernel], x, y, nodes_used, names, "STREAM " + kernel + " Minimum", experiment_name, kernel.lower() + "_min.png", dpi_value)
+
+        plot_graphs(kernel_max[kernel], x, y, nodes_used, names, "STREAM " + kernel + " Maximum", experiment_name, kernel.lower() + "_max.png", dpi_value)
 
 if __name__ == "__main__":
     main()
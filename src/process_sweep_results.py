@@ -0,0 +1,80 @@
+import xml.dom.minidom
+import sys
+import matplotlib
+import matplotlib.pyplot as plt
+
+# Plot the bandwidth against memory per process curve of every node for a kernel
+# Offset sweeps are plotted against the offset between the arrays rather than the memory per process
+def plot_curves(sizes, bandwidths, names, kernel, experiment_name, dpi_value, offsets):
+
+    fig, ax = plt.subplots(figsize=(12,8))
+    for name in names:
+        ax.plot(offsets if offsets else sizes, bandwidths[name], marker='.', label=name)
+    if offsets:
+        ax.set_xlabel('Offset between arrays (elements)')
+    else:
+        ax.set_xscale('log', base=2)
+        ax.set_xlabel('Memory per process (KiB)')
+    ax.set_ylabel('Node bandwidth (MB/s)')
+    ax.set_title("STREAM " + kernel + " Sweep")
+    # A legend is only readable for a modest number of nodes
+    if len(names) <= 32:
+        ax.legend(fontsize=8, ncol=2)
+    fig.tight_layout()
+    fig.savefig(experiment_name + kernel.lower() + ("_offset" if offsets else "") + "_sweep.png", dpi=dpi_value, bbox_inches='tight')
+    plt.close(fig)
+
+
+def main():
+    if(len(sys.argv) != 2):
+        print("Error, expecting a single argument (the name of the sweep results file to process)")
+        print("Exiting")
+        exit()
+
+    dpi_value = 150
+
+    filename = sys.argv[1]
+
+    doc = xml.dom.minidom.parse(filename)
+
+    experiment = doc.getElementsByTagName("experiment")
+    experiment_name = experiment[0].firstChild.nodeValue
+    experiment_name = experiment_name.split(".")[0] + "_"
+
+    configuration = doc.getElementsByTagName("configuration")[0]
+    procs_per_node = int(configuration.getElementsByTagName("processes_per_node")[0].firstChild.nodeValue)
+    element_size = int(configuration.getElementsByTagName("element_size")[0].firstChild.nodeValue)
+
+    nodes = doc.getElementsByTagName("node")
+    names = []
+    sizes = []
+    offsets = []
+    # Node bandwidth for each kernel, keyed by node name
+    bandwidths = {}
+
+    for node in nodes:
+        name = node.getElementsByTagName("name")[0].firstChild.nodeValue
+        names.append(name)
+        points = node.getElementsByTagName("point")
+        if len(sizes) == 0:
+            for point in points:
+                array_size = float(point.getElementsByTagName("array_size")[0].firstChild.nodeValue)
+                # Three arrays per process
+                sizes.append(3*array_size*element_size/1024)
+                offset = point.getElementsByTagName("offset")
+                if len(offset) > 0:
+                    offsets.append(float(offset[0].firstChild.nodeValue))
+        for point in points:
+            for child in point.childNodes:
+                if child.nodeType != child.ELEMENT_NODE or child.tagName in ("array_size", "offset") or child.tagName.endswith("_size"):
+                    continue
+                kernel = child.tagName
+                size = float(point.getElementsByTagName(kernel.lower() + "_size")[0].firstChild.nodeValue)
+                avg = float(child.getElementsByTagName("Average")[0].firstChild.nodeValue)
+                bandwidths.setdefault(kernel, {}).setdefault(name, []).append((1E-6*procs_per_node*size)/avg)
+
+    for kernel in bandwidths:
+        plot_curves(sizes, bandwidths[kernel], names, kernel, experiment_name, dpi_value, offsets)
+
+if __name__ == "__main__":
+    main()
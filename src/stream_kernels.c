@@ -0,0 +1,896 @@
+#include "definitions.h"
+#include <stdint.h>
+#include <math.h>
+#include <complex.h>
+#include <strings.h>
+#include <sys/types.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#if defined(__ARM_FEATURE_SVE)
+#include <arm_sve.h>
+#endif
+#endif
+
+/*-----------------------------------------------------------------------
+ * Hand vectorised versions of the STREAM kernels.
+ *
+ * Every kernel has the same signature, dst[j] = f(x[j], y[j], scalar),
+ * which is enough to express Copy (c = a), Scale (b = scalar*c),
+ * Add (c = a + b), Triad (a = b + scalar*c), Fill (c = scalar) and
+ * Nstream (a = a + b + scalar*c). Each instruction set
+ * is provided twice, once using ordinary stores and once using
+ * non-temporal (streaming) stores that bypass the cache and so avoid
+ * the read-for-ownership (write allocate) traffic of ordinary stores.
+ *
+ * The kernels are generated for every element type in the data_types
+ * table. The vector kernels are only written for float and double
+ * elements, the integer and complex types use the scalar kernels (which
+ * the compiler is still free to vectorise).
+ *-----------------------------------------------------------------------*/
+
+// The absolute difference of two elements. The integer types are unsigned so
+// that the arithmetic in the kernels wraps rather than overflowing, so the
+// difference is taken in the direction that cannot wrap.
+#define REAL_DIFFERENCE(x, y) fabs((double)(x) - (double)(y))
+#define UNSIGNED_DIFFERENCE(x, y) ((x) > (y) ? (double)((x) - (y)) : (double)((y) - (x)))
+#define COMPLEX_DIFFERENCE(x, y) cabs((x) - (y))
+#define REAL_VALUE(x) ((double)(x))
+#define COMPLEX_VALUE(x) (creal(x) + cimag(x))
+
+// The elements of each array the stream count kernel handles at a time, small enough for the
+// block of partial sums to stay in the L1 cache
+#define STREAM_BLOCK_ELEMENTS 64
+
+// Generate the scalar kernels and the typed helpers for a single element type
+#define ELEMENT_TYPE_FUNCTIONS(suffix, type, difference, value) \
+static void copy_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	size_t j; \
+	for (j=0; j<n; j++) \
+		dst[j] = x[j]; \
+} \
+static void scale_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	type scalar = (type)scalar_v; \
+	size_t j; \
+	for (j=0; j<n; j++) \
+		dst[j] = scalar*x[j]; \
+} \
+static void add_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	const type *restrict y = y_v; \
+	size_t j; \
+	for (j=0; j<n; j++) \
+		dst[j] = x[j]+y[j]; \
+} \
+static void triad_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	const type *restrict y = y_v; \
+	type scalar = (type)scalar_v; \
+	size_t j; \
+	for (j=0; j<n; j++) \
+		dst[j] = x[j]+scalar*y[j]; \
+} \
+static void fill_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	type scalar = (type)scalar_v; \
+	size_t j; \
+	for (j=0; j<n; j++) \
+		dst[j] = scalar; \
+} \
+static void nstream_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	const type *restrict y = y_v; \
+	type scalar = (type)scalar_v; \
+	size_t j; \
+	for (j=0; j<n; j++) \
+		dst[j] = dst[j]+x[j]+scalar*y[j]; \
+} \
+/* The irregular kernels are left to the compiler, vector gathers and scatters are rarely faster. */ \
+static void gather_copy_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, const size_t *restrict index, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	size_t j; \
+	for (j=0; j<n; j++) \
+		dst[j] = x[index[j]]; \
+} \
+static void gather_triad_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, const size_t *restrict index, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	const type *restrict y = y_v; \
+	type scalar = (type)scalar_v; \
+	size_t j; \
+	for (j=0; j<n; j++) \
+		dst[j] = x[index[j]]+scalar*y[index[j]]; \
+} \
+static void scatter_copy_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, const size_t *restrict index, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	size_t j; \
+	for (j=0; j<n; j++) \
+		dst[index[j]] = x[j]; \
+} \
+static void scatter_triad_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, const size_t *restrict index, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	const type *restrict y = y_v; \
+	type scalar = (type)scalar_v; \
+	size_t j; \
+	for (j=0; j<n; j++) \
+		dst[index[j]] = x[j]+scalar*y[j]; \
+} \
+static void strided_copy_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n, size_t stride){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	size_t j, k; \
+	for (k=0; k<stride; k++) \
+		for (j=k; j<n; j+=stride) \
+			dst[j] = x[j]; \
+} \
+static void strided_triad_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n, size_t stride){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	const type *restrict y = y_v; \
+	type scalar = (type)scalar_v; \
+	size_t j, k; \
+	for (k=0; k<stride; k++) \
+		for (j=k; j<n; j+=stride) \
+			dst[j] = x[j]+scalar*y[j]; \
+} \
+/* The stream count kernel sums the first reads arrays into each of the next writes arrays. It works \
+   through a small block of elements at a time so every array is being streamed through at once. Without \
+   writes the sum is returned so the loads cannot be optimised away. */ \
+static double multi_stream_##suffix(void *const *arrays, int reads, int writes, size_t start, size_t n){ \
+	type block[STREAM_BLOCK_ELEMENTS]; \
+	type total = 0; \
+	size_t j, k, length; \
+	int s; \
+	for (k=start; k<start+n; k+=STREAM_BLOCK_ELEMENTS) { \
+		length = MIN(STREAM_BLOCK_ELEMENTS, start+n-k); \
+		for (j=0; j<length; j++) \
+			block[j] = 0; \
+		for (s=0; s<reads; s++) { \
+			const type *restrict x = (const type *)arrays[s] + k; \
+			for (j=0; j<length; j++) \
+				block[j] += x[j]; \
+		} \
+		for (s=reads; s<reads+writes; s++) { \
+			type *restrict dst = (type *)arrays[s] + k; \
+			for (j=0; j<length; j++) \
+				dst[j] = block[j]; \
+		} \
+		if (writes == 0) \
+			for (j=0; j<length; j++) \
+				total += block[j]; \
+	} \
+	return value(total); \
+} \
+/* The read only kernels are reductions over one thread's block, vectorised by the compiler through omp simd. */ \
+static double sum_##suffix(const void *x_v, size_t n){ \
+	const type *x = x_v; \
+	type total = 0; \
+	ssize_t j; \
+	_Pragma("omp simd reduction(+:total)") \
+	for (j=0; j<n; j++) \
+		total += x[j]; \
+	return value(total); \
+} \
+static double dot_##suffix(const void *x_v, const void *y_v, size_t n){ \
+	const type *x = x_v; \
+	const type *y = y_v; \
+	type total = 0; \
+	ssize_t j; \
+	_Pragma("omp simd reduction(+:total)") \
+	for (j=0; j<n; j++) \
+		total += x[j]*y[j]; \
+	return value(total); \
+} \
+static double relative_error_##suffix(const void *x_v, const void *expected_v, size_t n, double epsilon, size_t *errors){ \
+	const type *x = x_v; \
+	type expected = *(const type *)expected_v; \
+	double magnitude = difference(expected, (type)0); \
+	double error, total = 0; \
+	size_t j; \
+	if (magnitude == 0) \
+		magnitude = 1; \
+	*errors = 0; \
+	for (j=0; j<n; j++) { \
+		error = difference(x[j], expected); \
+		total += error; \
+		if (error/magnitude > epsilon) \
+			(*errors)++; \
+	} \
+	return (total/n)/magnitude; \
+}
+
+ELEMENT_TYPE_FUNCTIONS(float, float, REAL_DIFFERENCE, REAL_VALUE)
+ELEMENT_TYPE_FUNCTIONS(double, double, REAL_DIFFERENCE, REAL_VALUE)
+ELEMENT_TYPE_FUNCTIONS(int32, uint32_t, UNSIGNED_DIFFERENCE, REAL_VALUE)
+ELEMENT_TYPE_FUNCTIONS(int64, uint64_t, UNSIGNED_DIFFERENCE, REAL_VALUE)
+ELEMENT_TYPE_FUNCTIONS(complex, double complex, COMPLEX_DIFFERENCE, COMPLEX_VALUE)
+
+static int scalar_available(){
+	return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Generate a single x86 kernel. The scalar loops at the start peel elements
+// until the destination is aligned to the vector width, as aligned (and
+// streaming) stores require it; the source arrays are loaded unaligned
+// because their alignment relative to the destination is not known.
+#define X86_KERNEL(op, suffix, target_isa, type, vtype, width, store, set1, fence, vexpr, sexpr) \
+__attribute__((target(target_isa))) \
+static void op##_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	const type *restrict y = y_v; \
+	type scalar = (type)scalar_v; \
+	size_t j = 0; \
+	vtype s = set1(scalar); \
+	(void)s; \
+	(void)x; \
+	(void)y; \
+	for (; j<n && ((uintptr_t)&dst[j] % (width*sizeof(type))); j++) \
+		dst[j] = sexpr; \
+	for (; j+width<=n; j+=width) \
+		store(&dst[j], vexpr); \
+	for (; j<n; j++) \
+		dst[j] = sexpr; \
+	fence; \
+}
+
+#define X86_KERNEL_SET(suffix, target_isa, type, vtype, width, load, store, set1, vadd, vmul, fence) \
+X86_KERNEL(copy, suffix, target_isa, type, vtype, width, store, set1, fence, load(&x[j]), x[j]) \
+X86_KERNEL(scale, suffix, target_isa, type, vtype, width, store, set1, fence, vmul(s, load(&x[j])), scalar*x[j]) \
+X86_KERNEL(add, suffix, target_isa, type, vtype, width, store, set1, fence, vadd(load(&x[j]), load(&y[j])), x[j]+y[j]) \
+X86_KERNEL(triad, suffix, target_isa, type, vtype, width, store, set1, fence, vadd(load(&x[j]), vmul(s, load(&y[j]))), x[j]+scalar*y[j]) \
+X86_KERNEL(fill, suffix, target_isa, type, vtype, width, store, set1, fence, s, scalar) \
+X86_KERNEL(nstream, suffix, target_isa, type, vtype, width, store, set1, fence, vadd(load(&dst[j]), vadd(load(&x[j]), vmul(s, load(&y[j])))), dst[j]+x[j]+scalar*y[j])
+
+X86_KERNEL_SET(sse2_double, "sse2", double, __m128d, 2, _mm_loadu_pd, _mm_store_pd, _mm_set1_pd, _mm_add_pd, _mm_mul_pd, (void)0)
+X86_KERNEL_SET(sse2_stream_double, "sse2", double, __m128d, 2, _mm_loadu_pd, _mm_stream_pd, _mm_set1_pd, _mm_add_pd, _mm_mul_pd, _mm_sfence())
+X86_KERNEL_SET(avx2_double, "avx2", double, __m256d, 4, _mm256_loadu_pd, _mm256_store_pd, _mm256_set1_pd, _mm256_add_pd, _mm256_mul_pd, (void)0)
+X86_KERNEL_SET(avx2_stream_double, "avx2", double, __m256d, 4, _mm256_loadu_pd, _mm256_stream_pd, _mm256_set1_pd, _mm256_add_pd, _mm256_mul_pd, _mm_sfence())
+X86_KERNEL_SET(avx512_double, "avx512f", double, __m512d, 8, _mm512_loadu_pd, _mm512_store_pd, _mm512_set1_pd, _mm512_add_pd, _mm512_mul_pd, (void)0)
+X86_KERNEL_SET(avx512_stream_double, "avx512f", double, __m512d, 8, _mm512_loadu_pd, _mm512_stream_pd, _mm512_set1_pd, _mm512_add_pd, _mm512_mul_pd, _mm_sfence())
+
+X86_KERNEL_SET(sse2_float, "sse2", float, __m128, 4, _mm_loadu_ps, _mm_store_ps, _mm_set1_ps, _mm_add_ps, _mm_mul_ps, (void)0)
+X86_KERNEL_SET(sse2_stream_float, "sse2", float, __m128, 4, _mm_loadu_ps, _mm_stream_ps, _mm_set1_ps, _mm_add_ps, _mm_mul_ps, _mm_sfence())
+X86_KERNEL_SET(avx2_float, "avx2", float, __m256, 8, _mm256_loadu_ps, _mm256_store_ps, _mm256_set1_ps, _mm256_add_ps, _mm256_mul_ps, (void)0)
+X86_KERNEL_SET(avx2_stream_float, "avx2", float, __m256, 8, _mm256_loadu_ps, _mm256_stream_ps, _mm256_set1_ps, _mm256_add_ps, _mm256_mul_ps, _mm_sfence())
+X86_KERNEL_SET(avx512_float, "avx512f", float, __m512, 16, _mm512_loadu_ps, _mm512_store_ps, _mm512_set1_ps, _mm512_add_ps, _mm512_mul_ps, (void)0)
+X86_KERNEL_SET(avx512_stream_float, "avx512f", float, __m512, 16, _mm512_loadu_ps, _mm512_stream_ps, _mm512_set1_ps, _mm512_add_ps, _mm512_mul_ps, _mm_sfence())
+
+static int sse2_available(){
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+static int avx2_available(){
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+static int avx512_available(){
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512f");
+}
+
+#elif defined(__aarch64__)
+
+// NEON has no streaming form of vst1q, so use the STNP (store pair,
+// non-temporal) instruction on the two halves of the vector instead.
+static inline void neon_stream_store_double(double *p, float64x2_t v){
+	__asm__ volatile("stnp %d1, %d2, [%0]" : : "r"(p), "w"(vget_low_f64(v)), "w"(vget_high_f64(v)) : "memory");
+}
+
+static inline void neon_stream_store_float(float *p, float32x4_t v){
+	__asm__ volatile("stnp %d1, %d2, [%0]" : : "r"(p), "w"(vget_low_f32(v)), "w"(vget_high_f32(v)) : "memory");
+}
+
+#define NEON_KERNEL(op, suffix, type, vtype, width, dup, store, vexpr, sexpr) \
+static void op##_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	const type *restrict y = y_v; \
+	type scalar = (type)scalar_v; \
+	size_t j = 0; \
+	vtype s = dup(scalar); \
+	(void)s; \
+	(void)x; \
+	(void)y; \
+	for (; j+width<=n; j+=width) \
+		store(&dst[j], vexpr); \
+	for (; j<n; j++) \
+		dst[j] = sexpr; \
+}
+
+#define NEON_KERNEL_SET(suffix, type, vtype, width, dup, load, vadd, vmul, store) \
+NEON_KERNEL(copy, suffix, type, vtype, width, dup, store, load(&x[j]), x[j]) \
+NEON_KERNEL(scale, suffix, type, vtype, width, dup, store, vmul(s, load(&x[j])), scalar*x[j]) \
+NEON_KERNEL(add, suffix, type, vtype, width, dup, store, vadd(load(&x[j]), load(&y[j])), x[j]+y[j]) \
+NEON_KERNEL(triad, suffix, type, vtype, width, dup, store, vadd(load(&x[j]), vmul(s, load(&y[j]))), x[j]+scalar*y[j]) \
+NEON_KERNEL(fill, suffix, type, vtype, width, dup, store, s, scalar) \
+NEON_KERNEL(nstream, suffix, type, vtype, width, dup, store, vadd(load(&dst[j]), vadd(load(&x[j]), vmul(s, load(&y[j])))), dst[j]+x[j]+scalar*y[j])
+
+NEON_KERNEL_SET(neon_double, double, float64x2_t, 2, vdupq_n_f64, vld1q_f64, vaddq_f64, vmulq_f64, vst1q_f64)
+NEON_KERNEL_SET(neon_stream_double, double, float64x2_t, 2, vdupq_n_f64, vld1q_f64, vaddq_f64, vmulq_f64, neon_stream_store_double)
+NEON_KERNEL_SET(neon_float, float, float32x4_t, 4, vdupq_n_f32, vld1q_f32, vaddq_f32, vmulq_f32, vst1q_f32)
+NEON_KERNEL_SET(neon_stream_float, float, float32x4_t, 4, vdupq_n_f32, vld1q_f32, vaddq_f32, vmulq_f32, neon_stream_store_float)
+
+static int neon_available(){
+	return (getauxval(AT_HWCAP) & HWCAP_ASIMD) != 0;
+}
+
+#if defined(__ARM_FEATURE_SVE)
+// SVE kernels are vector length agnostic, the predicate from svwhilelt
+// covers the remainder so no scalar tail loop is needed.
+#define SVE_KERNEL(op, suffix, type, count, whilelt, store, vexpr) \
+static void op##_##suffix(void *restrict dst_v, const void *restrict x_v, const void *restrict y_v, double scalar_v, size_t n){ \
+	type *restrict dst = dst_v; \
+	const type *restrict x = x_v; \
+	const type *restrict y = y_v; \
+	type scalar = (type)scalar_v; \
+	uint64_t j; \
+	svbool_t pg; \
+	(void)x; \
+	(void)y; \
+	for (j=0; j<n; j+=count()) { \
+		pg = whilelt(j, n); \
+		store(pg, &dst[j], vexpr); \
+	} \
+}
+
+#define SVE_KERNEL_SET(suffix, type, count, whilelt, load, vadd, vmul, dup, store) \
+SVE_KERNEL(copy, suffix, type, count, whilelt, store, load(pg, &x[j])) \
+SVE_KERNEL(scale, suffix, type, count, whilelt, store, vmul(pg, load(pg, &x[j]), scalar)) \
+SVE_KERNEL(add, suffix, type, count, whilelt, store, vadd(pg, load(pg, &x[j]), load(pg, &y[j]))) \
+SVE_KERNEL(triad, suffix, type, count, whilelt, store, vadd(pg, load(pg, &x[j]), vmul(pg, load(pg, &y[j]), scalar))) \
+SVE_KERNEL(fill, suffix, type, count, whilelt, store, dup(scalar)) \
+SVE_KERNEL(nstream, suffix, type, count, whilelt, store, vadd(pg, load(pg, &dst[j]), vadd(pg, load(pg, &x[j]), vmul(pg, load(pg, &y[j]), scalar))))
+
+SVE_KERNEL_SET(sve_double, double, svcntd, svwhilelt_b64_u64, svld1_f64, svadd_f64_x, svmul_n_f64_x, svdup_n_f64, svst1_f64)
+SVE_KERNEL_SET(sve_stream_double, double, svcntd, svwhilelt_b64_u64, svld1_f64, svadd_f64_x, svmul_n_f64_x, svdup_n_f64, svstnt1_f64)
+SVE_KERNEL_SET(sve_float, float, svcntw, svwhilelt_b32_u64, svld1_f32, svadd_f32_x, svmul_n_f32_x, svdup_n_f32, svst1_f32)
+SVE_KERNEL_SET(sve_stream_float, float, svcntw, svwhilelt_b32_u64, svld1_f32, svadd_f32_x, svmul_n_f32_x, svdup_n_f32, svstnt1_f32)
+
+static int sve_available(){
+	return (getauxval(AT_HWCAP) & HWCAP_SVE) != 0;
+}
+#endif
+
+#endif
+
+#define KERNEL_SET(isa, store, available, suffix) \
+	{isa, store, available, copy_##suffix, scale_##suffix, add_##suffix, triad_##suffix, fill_##suffix, nstream_##suffix}
+
+// The available kernel sets for each element type, in order of preference. The
+// first set whose instruction set is supported by the processor we are running on,
+// and which matches the requested store type, is the one that is used. The scalar
+// kernels have no streaming store form so they are used for both store types, and
+// select_kernel_set reports this through the store member.
+static kernel_set float_kernel_sets[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	KERNEL_SET("avx512", streaming_stores, avx512_available, avx512_stream_float),
+	KERNEL_SET("avx512", regular_stores, avx512_available, avx512_float),
+	KERNEL_SET("avx2", streaming_stores, avx2_available, avx2_stream_float),
+	KERNEL_SET("avx2", regular_stores, avx2_available, avx2_float),
+	KERNEL_SET("sse2", streaming_stores, sse2_available, sse2_stream_float),
+	KERNEL_SET("sse2", regular_stores, sse2_available, sse2_float),
+#elif defined(__aarch64__)
+#if defined(__ARM_FEATURE_SVE)
+	KERNEL_SET("sve", streaming_stores, sve_available, sve_stream_float),
+	KERNEL_SET("sve", regular_stores, sve_available, sve_float),
+#endif
+	KERNEL_SET("neon", streaming_stores, neon_available, neon_stream_float),
+	KERNEL_SET("neon", regular_stores, neon_available, neon_float),
+#endif
+	KERNEL_SET("scalar", regular_stores, scalar_available, float),
+};
+
+static kernel_set double_kernel_sets[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	KERNEL_SET("avx512", streaming_stores, avx512_available, avx512_stream_double),
+	KERNEL_SET("avx512", regular_stores, avx512_available, avx512_double),
+	KERNEL_SET("avx2", streaming_stores, avx2_available, avx2_stream_double),
+	KERNEL_SET("avx2", regular_stores, avx2_available, avx2_double),
+	KERNEL_SET("sse2", streaming_stores, sse2_available, sse2_stream_double),
+	KERNEL_SET("sse2", regular_stores, sse2_available, sse2_double),
+#elif defined(__aarch64__)
+#if defined(__ARM_FEATURE_SVE)
+	KERNEL_SET("sve", streaming_stores, sve_available, sve_stream_double),
+	KERNEL_SET("sve", regular_stores, sve_available, sve_double),
+#endif
+	KERNEL_SET("neon", streaming_stores, neon_available, neon_stream_double),
+	KERNEL_SET("neon", regular_stores, neon_available, neon_double),
+#endif
+	KERNEL_SET("scalar", regular_stores, scalar_available, double),
+};
+
+static kernel_set int32_kernel_sets[] = {
+	KERNEL_SET("scalar", regular_stores, scalar_available, int32),
+};
+
+static kernel_set int64_kernel_sets[] = {
+	KERNEL_SET("scalar", regular_stores, scalar_available, int64),
+};
+
+static kernel_set complex_kernel_sets[] = {
+	KERNEL_SET("scalar", regular_stores, scalar_available, complex),
+};
+
+#define KERNEL_SETS(sets) sets, sizeof(sets)/sizeof(sets[0])
+#define IRREGULAR_KERNELS(suffix) gather_copy_##suffix, gather_triad_##suffix, scatter_copy_##suffix, scatter_triad_##suffix, strided_copy_##suffix, strided_triad_##suffix
+
+// The element types the kernels can be run with. The order of the table must
+// match the element_type enum in definitions.h. The integer types are validated
+// exactly, so their epsilon is zero.
+data_type data_types[] = {
+	{"float", sizeof(float), KERNEL_SETS(float_kernel_sets), sum_float, dot_float, relative_error_float, IRREGULAR_KERNELS(float), multi_stream_float, 1.e-6, 0},
+	{"double", sizeof(double), KERNEL_SETS(double_kernel_sets), sum_double, dot_double, relative_error_double, IRREGULAR_KERNELS(double), multi_stream_double, 1.e-13, 1},
+	{"int32", sizeof(uint32_t), KERNEL_SETS(int32_kernel_sets), sum_int32, dot_int32, relative_error_int32, IRREGULAR_KERNELS(int32), multi_stream_int32, 0, 0},
+	{"int64", sizeof(uint64_t), KERNEL_SETS(int64_kernel_sets), sum_int64, dot_int64, relative_error_int64, IRREGULAR_KERNELS(int64), multi_stream_int64, 0, 0},
+	{"complex", sizeof(double complex), KERNEL_SETS(complex_kernel_sets), sum_complex, dot_complex, relative_error_complex, IRREGULAR_KERNELS(complex), multi_stream_complex, 1.e-13, 0},
+};
+
+const int num_data_types = sizeof(data_types)/sizeof(data_types[0]);
+
+// Choose the best kernel set for this processor, element type and the requested store type.
+// If no vector kernel set supports the store type the scalar kernels are returned,
+// so callers should check the store member of the result to see what they got.
+kernel_set *select_kernel_set(data_type *type, store_state store){
+	int i;
+
+	for(i=0; i<type->num_kernel_sets; i++){
+		if(type->kernel_sets[i].store == store && type->kernel_sets[i].available()){
+			return &type->kernel_sets[i];
+		}
+	}
+	return &type->kernel_sets[type->num_kernel_sets-1];
+}
+
+// Work out the contiguous block of a loop of array_size iterations that the calling
+// thread should undertake. This matches the decomposition used by a static schedule,
+// so the same thread touches the same part of each array as in the initialisation loop.
+void get_thread_chunk(size_t array_size, size_t *start, size_t *length){
+	size_t quotient, remainder;
+	int thread = 0;
+	int threads = 1;
+
+#ifdef _OPENMP
+	thread = omp_get_thread_num();
+	threads = omp_get_num_threads();
+#endif
+	quotient = array_size/threads;
+	remainder = array_size%threads;
+	if(thread < remainder){
+		*length = quotient + 1;
+		*start = thread*(*length);
+	}else{
+		*length = quotient;
+		*start = remainder + thread*quotient;
+	}
+}
+
+// Where each thread records how long its share of a kernel took, indexed by thread
+// number, or NULL when the threads are not being timed
+static double *thread_times = NULL;
+
+void set_thread_times(double *times){
+	thread_times = times;
+}
+
+static inline double start_thread_time(){
+	return (thread_times == NULL) ? 0 : mysecond();
+}
+
+static inline void stop_thread_time(double start){
+	int thread = 0;
+
+	if(thread_times == NULL){
+		return;
+	}
+#ifdef _OPENMP
+	thread = omp_get_thread_num();
+#endif
+	thread_times[thread] = mysecond() - start;
+}
+
+// The kernels are either run by a parallel region of their own, or, in the persistent team
+// mode of the memory task, called by every thread of a team that is already running. In
+// that case each thread just processes its block, and the caller synchronises the team.
+#ifndef _OPENMP
+#	define omp_in_parallel() 0
+#endif
+#define ON_TEAM(...) \
+	if(omp_in_parallel()){ \
+		__VA_ARGS__ \
+	}else{ \
+		_Pragma("omp parallel") \
+		{ \
+			__VA_ARGS__ \
+		} \
+	}
+
+// Sum a value over the threads of the team that is already running, every thread gets the total
+static double team_sum(double value){
+	static double total;
+	double result;
+
+#pragma omp single
+	total = 0;
+#pragma omp atomic
+	total += value;
+#pragma omp barrier
+	result = total;
+	// Keep the total until every thread has read it, in case the next reduction follows straight on
+#pragma omp barrier
+	return result;
+}
+
+// Run a kernel across all the OpenMP threads, each thread processing its own
+// block of the arrays.
+void run_kernel(kernel_function kernel, void *dst, void *x, void *y, double scalar, size_t array_size, int element_size){
+	ON_TEAM({
+		size_t start, length;
+		double t = start_thread_time();
+
+		get_thread_chunk(array_size, &start, &length);
+		start = start*element_size;
+		kernel((char *)dst+start, (x == NULL) ? NULL : (char *)x+start, (y == NULL) ? NULL : (char *)y+start, scalar, length);
+		stop_thread_time(t);
+	})
+}
+
+// Reduce this thread's block of the arrays with the sum (y is NULL) or dot product
+static double reduce_thread_chunk(data_type *type, void *x, void *y, size_t array_size){
+	size_t start, length;
+	double total;
+	double t = start_thread_time();
+
+	get_thread_chunk(array_size, &start, &length);
+	start = start*type->size;
+	if(y == NULL){
+		total = type->sum((char *)x+start, length);
+	}else{
+		total = type->dot((char *)x+start, (char *)y+start, length);
+	}
+	stop_thread_time(t);
+	return total;
+}
+
+// Run the sum (y is NULL) or dot product reduction across all the OpenMP threads, each
+// thread reducing its own block of the arrays
+static double run_reduction(data_type *type, void *x, void *y, size_t array_size){
+	double total = 0;
+
+	if(omp_in_parallel()){
+		return team_sum(reduce_thread_chunk(type, x, y, array_size));
+	}
+#pragma omp parallel reduction(+:total)
+	total += reduce_thread_chunk(type, x, y, array_size);
+	return total;
+}
+
+static double multi_stream_thread_chunk(multi_stream_function kernel, void **arrays, int reads, int writes, size_t array_size){
+	size_t start, length;
+	double total;
+	double t = start_thread_time();
+
+	get_thread_chunk(array_size, &start, &length);
+	total = kernel(arrays, reads, writes, start, length);
+	stop_thread_time(t);
+	return total;
+}
+
+// Run the stream count kernel across all the OpenMP threads, each thread processing its
+// own block of every array
+double run_multi_stream_kernel(multi_stream_function kernel, void **arrays, int reads, int writes, size_t array_size){
+	double total = 0;
+
+	if(omp_in_parallel()){
+		return team_sum(multi_stream_thread_chunk(kernel, arrays, reads, writes, array_size));
+	}
+#pragma omp parallel reduction(+:total)
+	total += multi_stream_thread_chunk(kernel, arrays, reads, writes, array_size);
+	return total;
+}
+
+// Run a gather kernel across all the OpenMP threads. Each thread writes its own block
+// of the destination, but the sources are read from anywhere in the arrays.
+void run_gather_kernel(index_kernel_function kernel, void *dst, void *x, void *y, size_t *index, double scalar, size_t array_size, int element_size){
+	ON_TEAM({
+		size_t start, length;
+		double t = start_thread_time();
+
+		get_thread_chunk(array_size, &start, &length);
+		kernel((char *)dst+start*element_size, x, y, index+start, scalar, length);
+		stop_thread_time(t);
+	})
+}
+
+// Run a scatter kernel across all the OpenMP threads. Each thread reads its own block
+// of the sources, but writes anywhere in the destination. The index array is a
+// permutation so no two threads write the same element.
+void run_scatter_kernel(index_kernel_function kernel, void *dst, void *x, void *y, size_t *index, double scalar, size_t array_size, int element_size){
+	ON_TEAM({
+		size_t start, length;
+		double t = start_thread_time();
+
+		get_thread_chunk(array_size, &start, &length);
+		start = start*element_size;
+		kernel(dst, (char *)x+start, (y == NULL) ? NULL : (char *)y+start, index+(start/element_size), scalar, length);
+		stop_thread_time(t);
+	})
+}
+
+// Run a strided kernel across all the OpenMP threads, each thread striding through its
+// own block of the arrays.
+void run_strided_kernel(strided_kernel_function kernel, void *dst, void *x, void *y, double scalar, size_t array_size, int element_size, size_t stride){
+	ON_TEAM({
+		size_t start, length;
+		double t = start_thread_time();
+
+		get_thread_chunk(array_size, &start, &length);
+		start = start*element_size;
+		kernel((char *)dst+start, (char *)x+start, (y == NULL) ? NULL : (char *)y+start, scalar, length, stride);
+		stop_thread_time(t);
+	})
+}
+
+/*-----------------------------------------------------------------------
+ * The kernel registry.
+ *
+ * Tasks, result collection, printing and saving all iterate over this
+ * table, so a new bandwidth kernel only needs a run function and an
+ * entry below. The order of the table is the order kernels are run in,
+ * and must match the benchmark_type enum in definitions.h.
+ *-----------------------------------------------------------------------*/
+
+static void copy_run(stream_arrays *arrays){
+	run_kernel(arrays->kernels->copy, arrays->c, arrays->a, NULL, arrays->scalar, arrays->array_size, arrays->type->size);
+}
+
+static void scale_run(stream_arrays *arrays){
+	run_kernel(arrays->kernels->scale, arrays->b, arrays->c, NULL, arrays->scalar, arrays->array_size, arrays->type->size);
+}
+
+static void add_run(stream_arrays *arrays){
+	run_kernel(arrays->kernels->add, arrays->c, arrays->a, arrays->b, arrays->scalar, arrays->array_size, arrays->type->size);
+}
+
+static void triad_run(stream_arrays *arrays){
+	run_kernel(arrays->kernels->triad, arrays->a, arrays->b, arrays->c, arrays->scalar, arrays->array_size, arrays->type->size);
+}
+
+// The read only kernels have no stores so the store type does not apply to them.
+// The result is kept in the arrays structure so the loop cannot be optimised away.
+// In the persistent team mode every thread calls these, so only the master keeps the result.
+static void sum_run(stream_arrays *arrays){
+	double total = run_reduction(arrays->type, arrays->a, NULL, arrays->array_size);
+#pragma omp master
+	arrays->sum = total;
+}
+
+static void dot_run(stream_arrays *arrays){
+	double total = run_reduction(arrays->type, arrays->a, arrays->b, arrays->array_size);
+#pragma omp master
+	arrays->sum = total;
+}
+
+static void fill_run(stream_arrays *arrays){
+	run_kernel(arrays->kernels->fill, arrays->c, NULL, NULL, arrays->scalar, arrays->array_size, arrays->type->size);
+}
+
+static void nstream_run(stream_arrays *arrays){
+	run_kernel(arrays->kernels->nstream, arrays->a, arrays->b, arrays->c, arrays->scalar, arrays->array_size, arrays->type->size);
+}
+
+// The irregular kernels use the same arrays as Copy and Triad, so they leave the arrays with
+// the same values. Only the bytes of the elements are counted for them, not the index
+// array or the rest of each cache line, so they report an effective bandwidth.
+static void gather_copy_run(stream_arrays *arrays){
+	run_gather_kernel(arrays->type->gather_copy, arrays->c, arrays->a, NULL, arrays->index, arrays->scalar, arrays->array_size, arrays->type->size);
+}
+
+static void gather_triad_run(stream_arrays *arrays){
+	run_gather_kernel(arrays->type->gather_triad, arrays->a, arrays->b, arrays->c, arrays->index, arrays->scalar, arrays->array_size, arrays->type->size);
+}
+
+static void scatter_copy_run(stream_arrays *arrays){
+	run_scatter_kernel(arrays->type->scatter_copy, arrays->c, arrays->a, NULL, arrays->index, arrays->scalar, arrays->array_size, arrays->type->size);
+}
+
+static void scatter_triad_run(stream_arrays *arrays){
+	run_scatter_kernel(arrays->type->scatter_triad, arrays->a, arrays->b, arrays->c, arrays->index, arrays->scalar, arrays->array_size, arrays->type->size);
+}
+
+static void strided_copy_run(stream_arrays *arrays){
+	run_strided_kernel(arrays->type->strided_copy, arrays->c, arrays->a, NULL, arrays->scalar, arrays->array_size, arrays->type->size, arrays->stride);
+}
+
+static void strided_triad_run(stream_arrays *arrays){
+	run_strided_kernel(arrays->type->strided_triad, arrays->a, arrays->b, arrays->c, arrays->scalar, arrays->array_size, arrays->type->size, arrays->stride);
+}
+
+// The stream count kernel uses its own set of arrays, which are only allocated when it is run
+static void multi_stream_run(stream_arrays *arrays){
+	double total;
+
+	if(arrays->streams == NULL){
+		return;
+	}
+	total = run_multi_stream_kernel(arrays->type->multi_stream, arrays->streams, arrays->read_streams, arrays->write_streams, arrays->array_size);
+#pragma omp master
+	arrays->sum = total;
+}
+
+// The irregular and stream count kernels are much slower, or much bigger, than the others,
+// so they are only run when selected with the kernel list. The arrays the stream count
+// kernel reads and writes are set at runtime by set_stream_counts.
+benchmark_kernel kernel_registry[] = {
+	{"Copy", 1, 1, copy_run, 0, 1},
+	{"Scale", 1, 1, scale_run, 0, 1},
+	{"Add", 2, 1, add_run, 0, 1},
+	{"Triad", 2, 1, triad_run, 0, 1},
+	{"Sum", 1, 0, sum_run, 0, 1},
+	{"Dot", 2, 0, dot_run, 0, 1},
+	{"Fill", 0, 1, fill_run, 0, 1},
+	{"Nstream", 3, 1, nstream_run, 0, 1},
+	{"GatherCopy", 1, 1, gather_copy_run, 1, 0},
+	{"GatherTriad", 2, 1, gather_triad_run, 1, 0},
+	{"ScatterCopy", 1, 1, scatter_copy_run, 1, 0},
+	{"ScatterTriad", 2, 1, scatter_triad_run, 1, 0},
+	{"StrideCopy", 1, 1, strided_copy_run, 1, 0},
+	{"StrideTriad", 2, 1, strided_triad_run, 1, 0},
+	{"Streams", DEFAULT_READ_STREAMS, DEFAULT_WRITE_STREAMS, multi_stream_run, 0, 0},
+};
+
+const int num_kernels = sizeof(kernel_registry)/sizeof(kernel_registry[0]);
+
+// Set the number of arrays the stream count kernel reads and writes, so the bytes it moves
+// are counted correctly
+void set_stream_counts(int reads, int writes){
+	kernel_registry[streams].arrays_read = reads;
+	kernel_registry[streams].arrays_written = writes;
+}
+
+// Enable only the kernels named in a comma separated list (i.e. "copy,triad"),
+// switching all the others off. Returns 1 if the list contains a name that is
+// not in the registry, in which case the registry is left unchanged.
+int enable_kernels(char *kernel_list){
+	char list[MAX_FILE_NAME_LENGTH];
+	char *name;
+	char *saveptr;
+	int enabled[num_kernels];
+	int i, found;
+
+	for(i=0; i<num_kernels; i++){
+		enabled[i] = 0;
+	}
+
+	strncpy(list, kernel_list, MAX_FILE_NAME_LENGTH-1);
+	list[MAX_FILE_NAME_LENGTH-1] = '\0';
+	for(name = strtok_r(list, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr)){
+		found = 0;
+		for(i=0; i<num_kernels; i++){
+			if(strcasecmp(name, kernel_registry[i].name) == 0){
+				enabled[i] = 1;
+				found = 1;
+			}
+		}
+		if(!found){
+			return 1;
+		}
+	}
+
+	for(i=0; i<num_kernels; i++){
+		kernel_registry[i].enabled = enabled[i];
+	}
+	return 0;
+}
+
+// Enable only the element types named in a comma separated list (i.e. "float,double"),
+// in the same way as enable_kernels.
+int enable_data_types(char *type_list){
+	char list[MAX_FILE_NAME_LENGTH];
+	char *name;
+	char *saveptr;
+	int enabled[num_data_types];
+	int i, found;
+
+	for(i=0; i<num_data_types; i++){
+		enabled[i] = 0;
+	}
+
+	strncpy(list, type_list, MAX_FILE_NAME_LENGTH-1);
+	list[MAX_FILE_NAME_LENGTH-1] = '\0';
+	for(name = strtok_r(list, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr)){
+		found = 0;
+		for(i=0; i<num_data_types; i++){
+			if(strcasecmp(name, data_types[i].name) == 0){
+				enabled[i] = 1;
+				found = 1;
+			}
+		}
+		if(!found){
+			return 1;
+		}
+	}
+
+	for(i=0; i<num_data_types; i++){
+		data_types[i].enabled = enabled[i];
+	}
+	return 0;
+}
+
+// Compare the elements of x with the expected value on all the threads, returning the average
+// relative error and counting the elements whose relative error is above the epsilon of the
+// type. The array is checked in blocks of VALIDATION_BLOCK elements, and with a sample of n > 1
+// only the first block of every n is checked, so the cost of validating large arrays can be
+// cut down while still covering the whole length of the arrays.
+double validate_array(data_type *type, void *x, void *expected, size_t array_size, size_t sample, size_t *errors){
+	size_t blocks = (array_size + VALIDATION_BLOCK - 1)/VALIDATION_BLOCK;
+	size_t checked = 0, total_errors = 0;
+	double total = 0;
+	ssize_t block;
+
+	sample = MAX(sample, 1);
+#pragma omp parallel for schedule(static) reduction(+:total, checked, total_errors)
+	for(block=0; block<blocks; block+=sample){
+		size_t start = block*VALIDATION_BLOCK;
+		size_t length = MIN(VALIDATION_BLOCK, array_size - start);
+		size_t block_errors;
+
+		// The error is an average over the block, so weight it by the length of the block
+		total += length*type->relative_error((char *)x + start*type->size, expected, length, type->epsilon, &block_errors);
+		total_errors += block_errors;
+		checked += length;
+	}
+	*errors = total_errors;
+
+	return (checked > 0) ? total/checked : 0;
+}
+
+// Reproduce, on single values, the effect of running all the kernels that have been
+// used repeats times. The values passed in should be the initial array values, and are
+// elements of the given type. The kernels are run on the single values using the scalar
+// kernel set, so the vector kernels are checked against the scalar ones.
+void expected_values(data_type *type, performance_result *results, int repeats, double scalar, void *aj, void *bj, void *cj){
+	stream_arrays values;
+	size_t index = 0;
+	int i, k;
+
+	values.a = aj;
+	values.b = bj;
+	values.c = cj;
+	values.scalar = scalar;
+	values.array_size = 1;
+	values.type = type;
+	values.kernels = &type->kernel_sets[type->num_kernel_sets-1];
+	values.index = &index;
+	values.stride = 1;
+	// The stream count kernel does not change the other arrays
+	values.streams = NULL;
+
+	for(k=0; k<repeats; k++){
+		for(i=0; i<num_kernels; i++){
+			if(results[i].used){
+				kernel_registry[i].run(&values);
+			}
+		}
+	}
+}
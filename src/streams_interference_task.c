@@ -0,0 +1,182 @@
+#include "definitions.h"
+#include "utilities.h"
+#include <time.h>
+
+/*-----------------------------------------------------------------------
+ * Memory interference task.
+ *
+ *	The last processes of each node act as background traffic generators
+ *	while the others run the memory task kernels, measuring how much of
+ *	their bandwidth is left while a neighbour is using the memory system.
+ *	The generators run the Triad kernel, first flat out on their own to
+ *	find their peak bandwidth, and then paced to fractions of that peak.
+ *	The pacing uses timed duty cycles: in each period a generator runs
+ *	Triad over successive blocks of its arrays until it has moved its
+ *	share of the traffic for the period, then sleeps for the rest of it.
+ *	Fractions of 100% or more run flat out.
+ *
+ *	The kernels are measured once with the generators idle, as the
+ *	baseline, and then once for each load fraction, which gives the
+ *	bandwidth against background load (interference) curve of each node.
+ *-----------------------------------------------------------------------*/
+
+// Length of a duty cycle of the generators, in seconds, and the block of each array they run
+// Triad over at a time. A block takes far longer than starting the threads on it, while the
+// period is still short compared to the kernels being measured.
+#define GENERATOR_PERIOD	0.002
+#define GENERATOR_BLOCK_BYTES	(1024*1024)
+
+static double generate_traffic(kernel_set *kernels, data_type *type, void *a, void *b, void *c, size_t array_size, double target, MPI_Request *request);
+
+int stream_interference_task(interference_results *i_results, communicator world_comm, communicator node_comm, size_t array_size, task_settings settings, int generators, int repeats){
+	communicator		group_comm;
+	MPI_Comm			temp_comm;
+	MPI_Request			request;
+	benchmark_results	b_results;
+	data_type			*type = settings.type;
+	kernel_set			*kernels = select_kernel_set(type, regular_stores);
+	void				*a = NULL, *b = NULL, *c = NULL;
+	double				triad_bytes = (double)(kernel_registry[triad].arrays_read + kernel_registry[triad].arrays_written) * type->size * array_size;
+	double				t, best, size, peak, generated;
+	double				best_times[num_kernels];
+	int					generator, point, i, k;
+
+	// The generators are the last processes of the node, the measuring processes form their own
+	// group (keeping the first process of the node as its first process)
+	generator = node_comm.rank >= node_comm.size - generators;
+	MPI_Comm_split(node_comm.comm, generator, node_comm.rank, &temp_comm);
+	group_comm.comm = temp_comm;
+	MPI_Comm_size(temp_comm, &group_comm.size);
+	MPI_Comm_rank(temp_comm, &group_comm.rank);
+
+	if(world_comm.rank == ROOT){
+		printf("Stream Interference Task\n");
+		printf("%d process(es) per node generate Triad traffic over %zu %s elements while the other %d run the kernels.\n", generators, array_size, type->name, node_comm.size - generators);
+		printf("The kernels are measured with the generators idle and then at");
+		for(point=1; point<i_results->num_points; point++){
+			printf(" %d%%", i_results->fractions[point]);
+		}
+		printf(" of the generators' peak bandwidth, paced in %.1f ms duty cycles.\n", 1.0E3*GENERATOR_PERIOD);
+		printf("Each measurement will be repeated %d times, the first is not counted.\n", repeats);
+	}
+
+	if(generator){
+		a = malloc((size_t)type->size*array_size);
+		b = malloc((size_t)type->size*array_size);
+		c = malloc((size_t)type->size*array_size);
+		run_kernel(kernels->fill, a, NULL, NULL, 1.0, array_size, type->size);
+		run_kernel(kernels->fill, b, NULL, NULL, 2.0, array_size, type->size);
+		run_kernel(kernels->fill, c, NULL, NULL, 0.0, array_size, type->size);
+	}
+
+	settings.store = regular_stores;
+	settings.verbose = 0;
+
+	/* --- Peak --- the generators run Triad flat out while the measuring processes wait --- */
+	peak = 0;
+	MPI_Barrier(node_comm.comm);
+	if(generator){
+		best = FLT_MAX;
+		for(k=0; k<repeats; k++){
+			MPI_Barrier(group_comm.comm);
+			t = mysecond();
+			run_kernel(kernels->triad, a, b, c, 3.0, array_size, type->size);
+			t = mysecond() - t;
+			// As for the node results the slowest generator limits each repeat
+			MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, group_comm.comm);
+			if(k > 0){
+				best = MIN(best, t);
+			}
+		}
+		peak = (1.0E-06 * triad_bytes)/best;
+	}
+	MPI_Reduce(&peak, &i_results->peak_bandwidth, 1, MPI_DOUBLE, MPI_SUM, ROOT, node_comm.comm);
+
+	/* --- Interference --- the generators run until the measuring processes are done --- */
+	// As in the latency task, the non-blocking barrier tells the generators the measurement
+	// has finished. They start before the measuring processes do, which only affects the
+	// first repeat, and that is not counted.
+	for(point=0; point<i_results->num_points; point++){
+		MPI_Barrier(node_comm.comm);
+		generated = 0;
+		if(generator){
+			MPI_Ibarrier(node_comm.comm, &request);
+			if(i_results->fractions[point] > 0){
+				generated = generate_traffic(kernels, type, a, b, c, array_size, (i_results->fractions[point] >= 100) ? 0 : peak*i_results->fractions[point]/100.0, &request);
+			}else{
+				MPI_Wait(&request, MPI_STATUS_IGNORE);
+			}
+		}else{
+			initialise_benchmark_results(&b_results, repeats);
+			stream_memory_task(&b_results, world_comm, group_comm, array_size, settings, repeats);
+			MPI_Ibarrier(node_comm.comm, &request);
+			MPI_Wait(&request, MPI_STATUS_IGNORE);
+			// As for the node results, the slowest process limits each repeat, and the best repeat is used
+			node_best_times(&b_results, group_comm, best_times);
+			for(i=0; i<num_kernels; i++){
+				i_results->bandwidths[point*num_kernels + i] = 0;
+				if(!b_results.results[i].used){
+					continue;
+				}
+				size = (double)(kernel_registry[i].arrays_read + kernel_registry[i].arrays_written) * type->size * array_size * group_comm.size;
+				i_results->bandwidths[point*num_kernels + i] = (1.0E-06 * size)/best_times[i];
+			}
+			free_benchmark_results(&b_results);
+		}
+		MPI_Reduce(&generated, &i_results->generated[point], 1, MPI_DOUBLE, MPI_SUM, ROOT, node_comm.comm);
+	}
+
+	get_node_name(i_results->name);
+
+	if(generator){
+		free(a);
+		free(b);
+		free(c);
+	}
+	MPI_Comm_free(&group_comm.comm);
+
+	return 0;
+}
+
+// Run Triad over successive blocks of the arrays until the request completes, returning the
+// bandwidth achieved (in MB/s). With a target (in MB/s) the blocks are run in periods of
+// GENERATOR_PERIOD seconds, each stopping once the period's share of the target has been moved
+// and sleeping until the next period starts, otherwise they are run flat out.
+static double generate_traffic(kernel_set *kernels, data_type *type, void *a, void *b, void *c, size_t array_size, double target, MPI_Request *request){
+	size_t block = MIN(MAX(GENERATOR_BLOCK_BYTES/type->size, 1), array_size);
+	size_t start = 0, length;
+	double element_bytes = (double)(kernel_registry[triad].arrays_read + kernel_registry[triad].arrays_written) * type->size;
+	double period_bytes = 1.0E06*target*GENERATOR_PERIOD;
+	double moved, total, begin, period_start, remaining;
+	struct timespec pause;
+	int done = 0;
+
+	total = 0;
+	begin = mysecond();
+	period_start = begin;
+	while(!done){
+		moved = 0;
+		do {
+			length = MIN(block, array_size - start);
+			run_kernel(kernels->triad, (char *)a + start*type->size, (char *)b + start*type->size, (char *)c + start*type->size, 3.0, length, type->size);
+			moved = moved + element_bytes*length;
+			start = (start + length == array_size) ? 0 : start + length;
+		} while(target > 0 && moved < period_bytes);
+		total = total + moved;
+		if(target > 0){
+			period_start = period_start + GENERATOR_PERIOD;
+			remaining = period_start - mysecond();
+			if(remaining > 0){
+				pause.tv_sec = 0;
+				pause.tv_nsec = (long)(remaining * 1.0E9);
+				nanosleep(&pause, NULL);
+			}else if(remaining < -GENERATOR_PERIOD){
+				// Start again from now rather than catching up with a burst at full speed
+				period_start = mysecond();
+			}
+		}
+		MPI_Test(request, &done, MPI_STATUS_IGNORE);
+	}
+
+	return (1.0E-06 * total)/(mysecond() - begin);
+}
@@ -0,0 +1,197 @@
+#include "definitions.h"
+#include "utilities.h"
+#include <unistd.h>
+
+/*-----------------------------------------------------------------------
+ * Memory latency task.
+ *
+ *	A single thread on the first process of each node follows a chain of
+ *	pointers through a buffer of the requested size. Each pointer is in
+ *	its own cache line, and the chain visits the lines in a random order
+ *	(a single cycle through all of them), so every load depends on the
+ *	one before it and the hardware prefetchers cannot predict it. The
+ *	time per load is then the latency of whichever level of the memory
+ *	hierarchy the buffer fits in.
+ *
+ *	The latency is measured twice: with the rest of the node idle, and
+ *	while all the other processes on the node run the Triad kernel as
+ *	fast as they can. Together with the bandwidth the loading processes
+ *	achieve this gives a point on the latency against bandwidth curve of
+ *	the node.
+ *-----------------------------------------------------------------------*/
+
+// The size of the blocks the pointers are placed in, one pointer per cache line
+#ifndef CACHE_LINE_SIZE
+#	define CACHE_LINE_SIZE	64
+#endif
+
+// The fewest loads timed for each measurement, so small buffers are still timed accurately
+#define MIN_CHASE_STEPS	(1<<20)
+
+static void **build_chain(char *buffer, size_t lines, int seed);
+static double chase(void **start, size_t steps);
+
+// Where the chase ends, kept so the loads cannot be optimised away
+static void * volatile chase_end;
+
+int stream_latency_task(latency_results *l_results, communicator world_comm, communicator node_comm, size_t footprint, size_t array_size, int repeats){
+	char		*buffer = NULL;
+	void		**start = NULL;
+	void		*a, *b, *c;
+	size_t		lines, steps;
+	double		*times;
+	double		t, bandwidth;
+	long		passes;
+	int			done;
+	int			k;
+	MPI_Request	request;
+	data_type	*type = &data_types[STREAM_DATA_TYPE];
+	kernel_set	*kernels = select_kernel_set(type, regular_stores);
+
+	lines = MAX(footprint/CACHE_LINE_SIZE, 2);
+	steps = MAX(lines, MIN_CHASE_STEPS);
+	times = malloc(repeats * sizeof(double));
+
+	if(world_comm.rank == ROOT){
+		printf("Stream Latency Task\n");
+		printf("Pointer chasing through %.1f KiB (%zu cache lines of %d bytes), %zu loads per measurement.\n", lines*CACHE_LINE_SIZE/1024.0, lines, CACHE_LINE_SIZE, steps);
+		if(node_comm.size > 1){
+			printf("The loaded latency is measured while the other %d process(es) on each node run Triad over %zu %s elements.\n", node_comm.size-1, array_size, type->name);
+		}else{
+			printf("There is only one process per node, so only the idle latency is measured.\n");
+		}
+		printf("Each measurement will be repeated %d times, the first is not counted.\n", repeats);
+	}
+
+	// The first process on the node does the chasing, the others provide the load
+	if(node_comm.rank == ROOT){
+		if(posix_memalign((void **)&buffer, CACHE_LINE_SIZE, lines*CACHE_LINE_SIZE) != 0){
+			printf("Unable to allocate the %zu byte latency buffer.\n", lines*CACHE_LINE_SIZE);
+			MPI_Abort(world_comm.comm, 1);
+		}
+		start = build_chain(buffer, lines, world_comm.rank);
+		// Walk the whole chain once so it is resident wherever it fits before timing
+		chase(start, lines);
+	}else{
+		a = malloc((size_t)type->size*array_size);
+		b = malloc((size_t)type->size*array_size);
+		c = malloc((size_t)type->size*array_size);
+		run_kernel(kernels->fill, a, NULL, NULL, 1.0, array_size, type->size);
+		run_kernel(kernels->fill, b, NULL, NULL, 2.0, array_size, type->size);
+		run_kernel(kernels->fill, c, NULL, NULL, 0.0, array_size, type->size);
+	}
+
+	/* --- Idle latency --- the rest of the node waits in the barrier --- */
+	MPI_Barrier(node_comm.comm);
+	if(node_comm.rank == ROOT){
+		for(k=0; k<repeats; k++){
+			times[k] = chase(start, steps);
+		}
+		l_results->idle_latency = 0;
+		l_results->idle_min = FLT_MAX;
+		for(k=1; k<repeats; k++){
+			l_results->idle_latency = l_results->idle_latency + times[k];
+			l_results->idle_min = MIN(l_results->idle_min, times[k]);
+		}
+		l_results->idle_latency = 1.0E9*(l_results->idle_latency/(repeats-1))/steps;
+		l_results->idle_min = 1.0E9*l_results->idle_min/steps;
+	}
+	MPI_Barrier(node_comm.comm);
+
+	/* --- Loaded latency --- the other processes run Triad until the chasing is done --- */
+	// The non-blocking barrier is how the first process tells the others it has finished.
+	// The loading processes start their Triad loop before the chasing starts (and the first
+	// repeat, which could start before they do, is not counted).
+	bandwidth = 0;
+	MPI_Barrier(node_comm.comm);
+	if(node_comm.rank == ROOT){
+		for(k=0; k<repeats; k++){
+			times[k] = chase(start, steps);
+		}
+		MPI_Ibarrier(node_comm.comm, &request);
+		MPI_Wait(&request, MPI_STATUS_IGNORE);
+		l_results->loaded_latency = 0;
+		l_results->loaded_min = FLT_MAX;
+		for(k=1; k<repeats; k++){
+			l_results->loaded_latency = l_results->loaded_latency + times[k];
+			l_results->loaded_min = MIN(l_results->loaded_min, times[k]);
+		}
+		l_results->loaded_latency = 1.0E9*(l_results->loaded_latency/(repeats-1))/steps;
+		l_results->loaded_min = 1.0E9*l_results->loaded_min/steps;
+	}else{
+		MPI_Ibarrier(node_comm.comm, &request);
+		passes = 0;
+		done = 0;
+		t = mysecond();
+		while(!done){
+			run_kernel(kernels->triad, a, b, c, 3.0, array_size, type->size);
+			passes++;
+			MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+		}
+		t = mysecond() - t;
+		bandwidth = (1.0E-06 * passes * (kernel_registry[triad].arrays_read + kernel_registry[triad].arrays_written) * type->size * array_size)/t;
+	}
+	MPI_Reduce(&bandwidth, &l_results->loaded_bandwidth, 1, MPI_DOUBLE, MPI_SUM, ROOT, node_comm.comm);
+
+	// There is nothing to load the node with if there is only one process on it
+	if(node_comm.rank == ROOT && node_comm.size == 1){
+		l_results->loaded_latency = 0;
+		l_results->loaded_min = 0;
+	}
+
+	get_node_name(l_results->name);
+
+	if(node_comm.rank == ROOT){
+		free(buffer);
+	}else{
+		free(a);
+		free(b);
+		free(c);
+	}
+	free(times);
+
+	return 0;
+}
+
+// Link the cache lines of the buffer into a single cycle in a random order (using Sattolo's
+// algorithm), returning the start of the chain. The first pointer sized word of each line
+// points to the next line in the chain.
+static void **build_chain(char *buffer, size_t lines, int seed){
+	unsigned long long state = 0x9E3779B97F4A7C15ULL ^ (unsigned long long)(seed + 1);
+	size_t *order;
+	size_t i, j, temp;
+
+	order = malloc(lines * sizeof(size_t));
+	for(i=0; i<lines; i++){
+		order[i] = i;
+	}
+	for(i=lines-1; i>0; i--){
+		j = random_below(&state, i);
+		temp = order[i];
+		order[i] = order[j];
+		order[j] = temp;
+	}
+	for(i=0; i<lines; i++){
+		*(void **)(buffer + i*CACHE_LINE_SIZE) = buffer + order[i]*CACHE_LINE_SIZE;
+	}
+	free(order);
+
+	return (void **)buffer;
+}
+
+// Follow the chain for the given number of loads, returning the time taken
+static double chase(void **start, size_t steps){
+	void **p = start;
+	double t;
+	size_t i;
+
+	t = mysecond();
+	for(i=0; i<steps; i++){
+		p = (void **)*p;
+	}
+	t = mysecond() - t;
+	chase_end = p;
+
+	return t;
+}
+
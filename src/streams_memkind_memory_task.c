@@ -1,7 +1,6 @@
 #include "definitions.h"
 #include <unistd.h>
 #include <math.h>
-#include <sys/time.h>
 #include <memkind.h>
 
 /*-----------------------------------------------------------------------
@@ -40,16 +39,15 @@
 /*
  *     To run with single-precision variables and arithmetic, simply add
  *         -DSTREAM_TYPE=float
- *     to the compile line.
+ *     to the compile line. Only float and double are supported, and the
+ *     results are validated with the data_types entry of the same type.
  *     Note that this changes the array sizes required
  *
  *-----------------------------------------------------------------------*/
 
 
 
-static double mysecond();
-static void checkSTREAMresults(int array_size, int repeats);
-static int checktick();
+static void checkSTREAMresults(benchmark_results *b_results, int array_size, int repeats, size_t sample);
 
 #ifdef _OPENMP
 extern int omp_get_num_threads();
@@ -58,15 +56,16 @@ extern int omp_get_num_threads();
 STREAM_TYPE *a, *b, *c;
 
 
-int stream_memkind_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, int socket, size_t cache_size, int repeats, char *pmem_path){
+int stream_memkind_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, int socket, size_t cache_size, int repeats, char *pmem_path, size_t validation){
 	int			quantum;
 	int			BytesPerWord;
-	int			k;
+	int			i, k;
         int err;
 	ssize_t		j;
         size_t          pmem_size;
 	STREAM_TYPE		scalar;
-	double		t, times[4][repeats];
+	double		t;
+	stream_arrays	arrays;
         char filename[1000];
          struct memkind *my_data = NULL; 
 
@@ -144,15 +143,6 @@ int stream_memkind_memory_task(benchmark_results *b_results, communicator world_
 		c[j] = 0.0;
 	}
 
-	//if  ( (quantum = checktick()) >= 1)
-	//	printf("Your clock granularity/precision appears to be "
-	//			"%d microseconds.\n", quantum);
-	//else {
-	//	printf("Your clock granularity appears to be "
-	//			"less than one microsecond.\n");
-	//	quantum = 1;
-	//}
-
 	t = mysecond();
 #pragma omp parallel for
 	for (j = 0; j < *array_size; j++)
@@ -172,68 +162,49 @@ int stream_memkind_memory_task(benchmark_results *b_results, communicator world_
 	/*	--- MAIN LOOP --- repeat test cases repeats times --- */
 
 	scalar = 3.0;
+	arrays.a = a;
+	arrays.b = b;
+	arrays.c = c;
+	arrays.scalar = scalar;
+	arrays.array_size = *array_size;
+	arrays.type = &data_types[STREAM_DATA_TYPE];
+	arrays.kernels = select_kernel_set(arrays.type, regular_stores);
+	arrays.index = NULL;
+	arrays.stride = 1;
+
+	b_results->array_size = *array_size;
+	// The irregular and stream count kernels are only run by the main memory task
+	for (i=0; i<num_kernels; i++){
+		b_results->results[i].used = kernel_registry[i].enabled && !kernel_registry[i].irregular && i != streams;
+	}
+
 	for (k=0; k<repeats; k++)
 	{
-		// Add in a barrier synchronisation to ensure all processes on a node are undertaking the
-		// benchmark at the same time. This ensures the node level results are fair as all
-		// operations are synchronised on the node.
-		MPI_Barrier(node_comm.comm);
-		times[0][k] = mysecond();
-#pragma omp parallel for
-		for (j=0; j<*array_size; j++)
-			c[j] = a[j];
-		times[0][k] = mysecond() - times[0][k];
-		b_results->Copy.raw_result[k] = times[0][k];
-
-		MPI_Barrier(node_comm.comm);
-		times[1][k] = mysecond();
-#pragma omp parallel for
-		for (j=0; j<*array_size; j++)
-			b[j] = scalar*c[j];
-		times[1][k] = mysecond() - times[1][k];
-		b_results->Scale.raw_result[k] = times[1][k];
-
-		MPI_Barrier(node_comm.comm);
-		times[2][k] = mysecond();
-#pragma omp parallel for
-		for (j=0; j<*array_size; j++)
-			c[j] = a[j]+b[j];
-		times[2][k] = mysecond() - times[2][k];
-		b_results->Add.raw_result[k] = times[2][k];
-
-		MPI_Barrier(node_comm.comm);
-		times[3][k] = mysecond();
-#pragma omp parallel for
-		for (j=0; j<*array_size; j++)
-			a[j] = b[j]+scalar*c[j];
-		times[3][k] = mysecond() - times[3][k];
-		b_results->Triad.raw_result[k] = times[3][k];
+		for (i=0; i<num_kernels; i++){
+			if(!b_results->results[i].used){
+				continue;
+			}
+			// Add in a barrier synchronisation to ensure all processes on a node are undertaking the
+			// benchmark at the same time. This ensures the node level results are fair as all
+			// operations are synchronised on the node.
+			MPI_Barrier(node_comm.comm);
+			t = mysecond();
+			kernel_registry[i].run(&arrays);
+			b_results->results[i].raw_result[k] = mysecond() - t;
+		}
 	}
 
 	/*	--- SUMMARY --- */
-	/* note -- skip first iteration */
-	for (k=1; k<repeats; k++) {
-		b_results->Copy.avg = b_results->Copy.avg + times[0][k];
-		b_results->Copy.min = MIN(b_results->Copy.min, times[0][k]);
-		b_results->Copy.max = MAX(b_results->Copy.max, times[0][k]);
-		b_results->Scale.avg = b_results->Scale.avg + times[1][k];
-		b_results->Scale.min = MIN(b_results->Scale.min, times[1][k]);
-		b_results->Scale.max = MAX(b_results->Scale.max, times[1][k]);
-		b_results->Add.avg = b_results->Add.avg + times[2][k];
-		b_results->Add.min = MIN(b_results->Add.min, times[2][k]);
-		b_results->Add.max = MAX(b_results->Add.max, times[2][k]);
-		b_results->Triad.avg = b_results->Triad.avg + times[3][k];
-		b_results->Triad.min = MIN(b_results->Triad.min, times[3][k]);
-		b_results->Triad.max = MAX(b_results->Triad.max, times[3][k]);
-	}
-
-	b_results->Copy.avg = b_results->Copy.avg/(double)(repeats-1);
-	b_results->Scale.avg = b_results->Scale.avg/(double)(repeats-1);
-	b_results->Add.avg = b_results->Add.avg/(double)(repeats-1);
-	b_results->Triad.avg = b_results->Triad.avg/(double)(repeats-1);
+	summarise_benchmark_results(b_results, repeats);
 
 	/* --- Check Results --- */
-	checkSTREAMresults(*array_size, repeats);
+	// Timed separately so the cost of the validation is never mistaken for part of the benchmark
+	b_results->validation_time = -1;
+	if(validation > 0){
+		t = mysecond();
+		checkSTREAMresults(b_results, *array_size, repeats, validation);
+		b_results->validation_time = mysecond() - t;
+	}
 
 	memkind_free(my_data, a);
 	memkind_free(my_data, b);
@@ -242,59 +213,18 @@ int stream_memkind_memory_task(benchmark_results *b_results, communicator world_
 	return 0;
 }
 
-# define	M	20
-
-static int checktick(){
-	int		i, minDelta, Delta;
-	double	t1, t2, timesfound[M];
-
-	/*  Collect a sequence of M unique time values from the system. */
-
-	for (i = 0; i < M; i++) {
-		t1 = mysecond();
-		while( ((t2=mysecond()) - t1) < 1.0E-6 )
-			;
-		timesfound[i] = t1 = t2;
-	}
-
-	/*
-	 * Determine the minimum difference between these M values.
-	 * This result will be our estimate (in microseconds) for the
-	 * clock granularity.
-	 */
-
-	minDelta = 1000000;
-	for (i = 1; i < M; i++) {
-		Delta = (int)( 1.0E6 * (timesfound[i]-timesfound[i-1]));
-		minDelta = MIN(minDelta, MAX(Delta,0));
-	}
-
-	return(minDelta);
-}
-
-
-
-/* A gettimeofday routine to give access to the wall
-   clock timer on most UNIX-like systems.  */
-static double mysecond(){
-	struct timeval tp;
-	struct timezone tzp;
-	int i;
-
-	i = gettimeofday(&tp,&tzp);
-	return ( (double) tp.tv_sec + (double) tp.tv_usec * 1.e-6 );
-}
 
 #ifndef abs
 #define abs(a) ((a) >= 0 ? (a) : -(a))
 #endif
-static void checkSTREAMresults (int array_size, int repeats){
+static void checkSTREAMresults (benchmark_results *b_results, int array_size, int repeats, size_t sample){
+	// The arrays and the expected values below are elements of STREAM_TYPE
+	data_type *type = &data_types[STREAM_DATA_TYPE];
 	STREAM_TYPE aj,bj,cj,scalar;
-	STREAM_TYPE aSumErr,bSumErr,cSumErr;
-	STREAM_TYPE aAvgErr,bAvgErr,cAvgErr;
-	double epsilon;
-	ssize_t	j;
-	int	k,ierr,err;
+	double aAvgErr,bAvgErr,cAvgErr;
+	double epsilon = type->epsilon;
+	size_t aerr,berr,cerr;
+	int	err;
 
 	/* reproduce initialization */
 	aj = 1.0;
@@ -304,102 +234,38 @@ static void checkSTREAMresults (int array_size, int repeats){
 	aj = 2.0E0 * aj;
 	/* now execute timing loop */
 	scalar = 3.0;
-	for (k=0; k<repeats; k++)
-	{
-		cj = aj;
-		bj = scalar*cj;
-		cj = aj+bj;
-		aj = bj+scalar*cj;
-	}
-
-	/* accumulate deltas between observed and expected results */
-	aSumErr = 0.0;
-	bSumErr = 0.0;
-	cSumErr = 0.0;
-	for (j=0; j<array_size; j++) {
-		aSumErr += abs(a[j] - aj);
-		bSumErr += abs(b[j] - bj);
-		cSumErr += abs(c[j] - cj);
-		// if (j == 417) printf("Index 417: c[j]: %f, cj: %f\n",c[j],cj);	// MCCALPIN
-	}
-	aAvgErr = aSumErr / (STREAM_TYPE) array_size;
-	bAvgErr = bSumErr / (STREAM_TYPE) array_size;
-	cAvgErr = cSumErr / (STREAM_TYPE) array_size;
+	expected_values(type, b_results->results, repeats, scalar, &aj, &bj, &cj);
 
-	if (sizeof(STREAM_TYPE) == 4) {
-		epsilon = 1.e-6;
-	}
-	else if (sizeof(STREAM_TYPE) == 8) {
-		epsilon = 1.e-13;
-	}
-	else {
-		printf("WEIRD: sizeof(STREAM_TYPE) = %lu\n",sizeof(STREAM_TYPE));
-		epsilon = 1.e-6;
-	}
+	/* accumulate deltas between observed and expected results, counting the errors in the same (parallel) pass */
+	aAvgErr = validate_array(type, a, &aj, array_size, sample, &aerr);
+	bAvgErr = validate_array(type, b, &bj, array_size, sample, &berr);
+	cAvgErr = validate_array(type, c, &cj, array_size, sample, &cerr);
 
 	err = 0;
-	if (abs(aAvgErr/aj) > epsilon) {
+	if (aAvgErr > epsilon) {
 		err++;
 		printf ("Failed Validation on array a[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",aj,aAvgErr,abs(aAvgErr)/aj);
-		ierr = 0;
-		for (j=0; j<array_size; j++) {
-			if (abs(a[j]/aj-1.0) > epsilon) {
-				ierr++;
-#ifdef VERBOSE
-				if (ierr < 10) {
-					printf("         array a: index: %ld, expected: %e, observed: %e, relative error: %e\n",
-							j,aj,a[j],abs((aj-a[j])/aAvgErr));
-				}
-#endif
-			}
-		}
-		printf("     For array a[], %d errors were found.\n",ierr);
+		printf ("     Expected Value: %e, AvgRelAbsErr: %e\n",aj,aAvgErr);
+		printf("     For array a[], %zu errors were found.\n",aerr);
 	}
-	if (abs(bAvgErr/bj) > epsilon) {
+	if (bAvgErr > epsilon) {
 		err++;
 		printf ("Failed Validation on array b[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",bj,bAvgErr,abs(bAvgErr)/bj);
-		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
-		ierr = 0;
-		for (j=0; j<array_size; j++) {
-			if (abs(b[j]/bj-1.0) > epsilon) {
-				ierr++;
-#ifdef VERBOSE
-				if (ierr < 10) {
-					printf("         array b: index: %ld, expected: %e, observed: %e, relative error: %e\n",
-							j,bj,b[j],abs((bj-b[j])/bAvgErr));
-				}
-#endif
-			}
-		}
-		printf("     For array b[], %d errors were found.\n",ierr);
+		printf ("     Expected Value: %e, AvgRelAbsErr: %e\n",bj,bAvgErr);
+		printf("     For array b[], %zu errors were found.\n",berr);
 	}
-	if (abs(cAvgErr/cj) > epsilon) {
+	if (cAvgErr > epsilon) {
 		err++;
 		printf ("Failed Validation on array c[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",cj,cAvgErr,abs(cAvgErr)/cj);
-		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
-		ierr = 0;
-		for (j=0; j<array_size; j++) {
-			if (abs(c[j]/cj-1.0) > epsilon) {
-				ierr++;
-#ifdef VERBOSE
-				if (ierr < 10) {
-					printf("         array c: index: %ld, expected: %e, observed: %e, relative error: %e\n",
-							j,cj,c[j],abs((cj-c[j])/cAvgErr));
-				}
-#endif
-			}
-		}
-		printf("     For array c[], %d errors were found.\n",ierr);
+		printf ("     Expected Value: %e, AvgRelAbsErr: %e\n",cj,cAvgErr);
+		printf("     For array c[], %zu errors were found.\n",cerr);
 	}
 
 #ifdef VERBOSE
 	printf ("Results Validation Verbose Results: \n");
 	printf ("    Expected a(1), b(1), c(1): %f %f %f \n",aj,bj,cj);
 	printf ("    Observed a(1), b(1), c(1): %f %f %f \n",a[1],b[1],c[1]);
-	printf ("    Rel Errors on a, b, c:     %e %e %e \n",abs(aAvgErr/aj),abs(bAvgErr/bj),abs(cAvgErr/cj));
+	printf ("    Rel Errors on a, b, c:     %e %e %e \n",aAvgErr,bAvgErr,cAvgErr);
 #endif
 }
 
@@ -1,7 +1,11 @@
 #include "definitions.h"
+#include "utilities.h"
 #include <unistd.h>
 #include <math.h>
-#include <sys/time.h>
+#include <complex.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
 
 /*-----------------------------------------------------------------------
  * INSTRUCTIONS:
@@ -23,72 +27,184 @@
  *               This means the each array must be at least 1 GB.
  */
 
-/*  Users are allowed to modify the "OFFSET" variable, which *may* change the
- *         relative alignment of the arrays (though compilers may change the
- *         effective offset by making the arrays non-contiguous on some systems).
- *      Use of non-zero values for OFFSET can be especially helpful if the
- *         array size is set to a value close to a large power of 2.
- *      OFFSET can also be set on the compile line without changing the source
- *         code using, for example, "-DOFFSET=56".
+/*  The offset between the arrays, and the boundary they are aligned to, are
+ *         set at runtime (see task_settings). Each array starts offset elements
+ *         further from an alignment boundary than the one before, so the offset
+ *         changes which cache sets, and DRAM banks and channels, the same
+ *         element of each array maps to. Non-zero offsets can be especially
+ *         helpful if the array size is close to a large power of 2. The default
+ *         offset is OFFSET (see definitions.h), which can be set on the compile
+ *         line using, for example, "-DOFFSET=56".
  */
-#ifndef OFFSET
-#   define OFFSET	0
-#endif
 
 /*
- *     To run with single-precision variables and arithmetic, simply add
- *         -DSTREAM_TYPE=float
- *     to the compile line.
- *     Note that this changes the array sizes required
+ *     The element type is chosen at runtime (see the data_types table in
+ *         stream_kernels.c), and the task is run once for each type
+ *         that has been selected. Note that this changes the array
+ *         sizes required.
  *
  *-----------------------------------------------------------------------*/
 
 
 
-static double mysecond();
-static void checkSTREAMresults(int array_size, int repeats);
-static int checktick();
+// Progress through the repeat loop: the runs of the first repeat done so far, when the loop
+// started, the statistics of each kernel's node time, and whether the adaptive mode has stopped it
+typedef struct repeat_state {
+	int warmups;
+	int stop;
+	double start;
+	running_stats *node_times;
+} repeat_state;
+
+static int next_repeat(benchmark_results *b_results, repeat_state *state, task_settings settings, int k, communicator node_comm);
+static void checkSTREAMresults(benchmark_results *b_results, data_type *type, size_t array_size, int repeats, size_t sample);
+static void check_stream_results(data_type *type, void **arrays, int reads, int writes, size_t array_size, size_t sample);
+static void measure_team_overheads(double *fork_join, double *barrier);
+static void fill_value(data_type *type, void *element, double value);
+static void *allocate_array(size_t bytes, task_settings settings);
+static void free_array(void *array, size_t bytes, task_settings settings);
+static void *place_array(void *base, size_t alignment, size_t shift);
+static void record_thread_placement(benchmark_results *b_results, int end);
+static void build_index(size_t *index, size_t array_size, task_settings settings, int seed);
 
 #ifdef _OPENMP
 extern int omp_get_num_threads();
 #endif
 
-STREAM_TYPE	*a, *b, *c;
+static void	*a, *b, *c;
 
 
-int stream_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t *array_size, size_t cache_size, int repeats){
+// The number of elements in each array for each process on a node. The cache size is given
+// in elements of the default (STREAM_TYPE) type, so scale it so that every element type
+// covers the same amount of memory.
+size_t memory_task_array_size(size_t cache_size, data_type *type, communicator node_comm){
+	return ((cache_size*4*sizeof(STREAM_TYPE))/type->size)/node_comm.size;
+}
+
+int stream_memory_task(benchmark_results *b_results, communicator world_comm, communicator node_comm, size_t array_size, task_settings settings, int repeats){
 	int			quantum;
 	int			BytesPerWord;
-	int			k;
-	ssize_t		j;
-	STREAM_TYPE		scalar;
-	double		t, times[4][repeats];
-
-	*array_size = (cache_size*4)/node_comm.size;
-
-	a = malloc(sizeof(STREAM_TYPE)*(*array_size+OFFSET));
-	b = malloc(sizeof(STREAM_TYPE)*(*array_size+OFFSET));
-	c = malloc(sizeof(STREAM_TYPE)*(*array_size+OFFSET));
+	int			i, k;
+	double		scalar;
+	double		t;
+	double		coverage[2];
+	double		overheads[2], world_overheads[2];
+	stream_arrays	arrays;
+	data_type	*type = settings.type;
+	size_t		array_bytes = (size_t)type->size*array_size;
+	size_t		shift = (size_t)type->size*settings.offset;
+	// Room to move the start of each array to its alignment boundary and offset
+	size_t		allocated_bytes = array_bytes + settings.alignment + 2*shift;
+	void		*a_base, *b_base, *c_base;
+	size_t		*index = NULL;
+	int			indexed;
+	void		*multi_stream_bases[2*MAX_STREAMS];
+	void		*multi_streams[2*MAX_STREAMS];
+	int			num_streams = 0;
+	repeat_state	state;
+	int			next_k;
+	int			min_repeats, max_repeats;
+
+	a_base = allocate_array(allocated_bytes, settings);
+	b_base = allocate_array(allocated_bytes, settings);
+	c_base = allocate_array(allocated_bytes, settings);
+	a = place_array(a_base, settings.alignment, 0);
+	b = place_array(b_base, settings.alignment, shift);
+	c = place_array(c_base, settings.alignment, 2*shift);
+	// The index array is only needed if a gather or scatter kernel is being run
+	indexed = kernel_registry[gather_copy].enabled || kernel_registry[gather_triad].enabled || kernel_registry[scatter_copy].enabled || kernel_registry[scatter_triad].enabled;
+	if(indexed){
+		index = allocate_array(sizeof(size_t)*array_size, settings);
+	}
+	// As are the arrays of the stream count kernel, each offset from the one before like a, b and c
+	set_stream_counts(settings.read_streams, settings.write_streams);
+	if(kernel_registry[streams].enabled){
+		num_streams = settings.read_streams + settings.write_streams;
+		for(i=0; i<num_streams; i++){
+			multi_stream_bases[i] = allocate_array(array_bytes + settings.alignment + i*shift, settings);
+			multi_streams[i] = place_array(multi_stream_bases[i], settings.alignment, i*shift);
+		}
+	}
 	/* --- SETUP --- determine precision and check timing --- */
 
 	//printf("STREAM version $Revision: 5.10 $\n");
-	BytesPerWord = sizeof(STREAM_TYPE);
+	BytesPerWord = type->size;
+
 
+	arrays.kernels = select_kernel_set(type, settings.store);
 
-	if(world_comm.rank == ROOT){
+	// Measure what the kernels pay to start and finish on every thread, for the slowest process
+	// of each node and then of the whole run
+	measure_team_overheads(&overheads[0], &overheads[1]);
+	MPI_Allreduce(MPI_IN_PLACE, overheads, 2, MPI_DOUBLE, MPI_MAX, node_comm.comm);
+	b_results->fork_join_time = overheads[0];
+	b_results->team_barrier_time = overheads[1];
+	// The whole run is only reduced when the task is described, as some modes run the task on
+	// only some of the processes
+	if(settings.verbose){
+		MPI_Reduce(overheads, world_overheads, 2, MPI_DOUBLE, MPI_MAX, ROOT, world_comm.comm);
+	}
+
+	if(world_comm.rank == ROOT && settings.verbose){
 		printf("Stream Memory Task\n");
-		printf("This system uses %d bytes per array element.\n",BytesPerWord);
-		printf("Array size = %llu (elements), Offset = %d (elements)\n" , (unsigned long long) *array_size, OFFSET);
+		printf("Using %s kernels with %s stores.\n", arrays.kernels->isa, (arrays.kernels->store == streaming_stores) ? "streaming (non-temporal)" : "regular");
+		if(arrays.kernels->store != settings.store){
+			printf("Streaming stores are not available for these kernels, regular stores will be used.\n");
+		}
+		printf("Array elements are %s, using %d bytes per array element.\n", type->name, BytesPerWord);
+		printf("Array size = %llu (elements), Offset = %zu (elements)\n" , (unsigned long long) array_size, settings.offset);
+		if(settings.alignment > 0){
+			printf("Arrays are aligned to %zu bytes before the offset is applied.\n", settings.alignment);
+		}
 		printf("Memory per array = %.1f MiB (= %.1f GiB).\n",
-				BytesPerWord * ( (double) *array_size / 1024.0/1024.0),
-				BytesPerWord * ( (double) *array_size / 1024.0/1024.0/1024.0));
+				BytesPerWord * ( (double) array_size / 1024.0/1024.0),
+				BytesPerWord * ( (double) array_size / 1024.0/1024.0/1024.0));
 		printf("Total memory required per process = %.1f MiB (= %.1f GiB).\n",
-				(3.0 * BytesPerWord) * ( (double) *array_size / 1024.0/1024.),
-				(3.0 * BytesPerWord) * ( (double) *array_size / 1024.0/1024./1024.));
+				(3.0 * BytesPerWord) * ( (double) array_size / 1024.0/1024.),
+				(3.0 * BytesPerWord) * ( (double) array_size / 1024.0/1024./1024.));
 		printf("Total memory required per node = %.1f MiB (= %.1f GiB).\n",
-				node_comm.size * (3.0 * BytesPerWord) * ( (double) *array_size / 1024.0/1024.),
-				node_comm.size * (3.0 * BytesPerWord) * ( (double) *array_size / 1024.0/1024./1024.));
-		printf("Each kernel will be executed %d times.\n", repeats);
+				node_comm.size * (3.0 * BytesPerWord) * ( (double) array_size / 1024.0/1024.),
+				node_comm.size * (3.0 * BytesPerWord) * ( (double) array_size / 1024.0/1024./1024.));
+		if(indexed){
+			if(settings.distribution == blocked_index){
+				printf("Gather and scatter kernels use a random permutation of blocks of %zu elements, with a %.1f MiB index array per process.\n", settings.index_block, sizeof(size_t) * ((double) array_size / 1024.0/1024.0));
+			}else{
+				printf("Gather and scatter kernels use a random permutation of the elements, with a %.1f MiB index array per process.\n", sizeof(size_t) * ((double) array_size / 1024.0/1024.0));
+			}
+		}
+		if(kernel_registry[strided_copy].enabled || kernel_registry[strided_triad].enabled){
+			printf("Strided kernels use a stride of %zu elements.\n", settings.stride);
+		}
+		if(kernel_registry[streams].enabled){
+			printf("The Streams kernel reads %d and writes %d arrays of the same size.\n", settings.read_streams, settings.write_streams);
+		}
+		if(settings.pages != default_pages){
+			printf("Arrays are mapped with %s pages.\n", page_mode_name(settings.pages));
+		}
+		if(settings.thread_timing){
+			printf("Each thread's share of the kernels is timed to measure the thread imbalance.\n");
+		}
+		if(settings.persistent_team){
+			printf("The kernels are run by a single persistent OpenMP team, synchronised with thread barriers.\n");
+		}
+		if(settings.validation == 0){
+			printf("The results will not be validated.\n");
+		}else if(settings.validation > 1){
+			printf("The results will be validated on one block of %d elements in every %zu.\n", VALIDATION_BLOCK, settings.validation);
+		}
+		printf("OpenMP overheads (slowest process): fork/join %.2f us, team barrier %.2f us.\n", 1.0E6*world_overheads[0], 1.0E6*world_overheads[1]);
+		if(settings.target_confidence > 0){
+			printf("Each kernel will be repeated until the 95%% confidence interval of its node time is within %.2f%% of the mean, with at least %d and at most %d repeats", 100*settings.target_confidence, MIN(MIN_ADAPTIVE_REPEATS+1, repeats), repeats);
+			if(settings.time_budget > 0){
+				printf(", or until %.1f seconds have been spent on them", settings.time_budget);
+			}
+			printf(".\n");
+		}else{
+			printf("Each kernel will be executed %d times.\n", repeats);
+		}
+		if(settings.warmup > 1){
+			printf(" The first iteration is run %d times to warm up.\n", settings.warmup);
+		}
 		printf(" The *best* time for each kernel (excluding the first iteration)\n");
 		printf(" will be used to compute the reported bandwidth.\n");
 	}
@@ -113,26 +229,41 @@ int stream_memory_task(benchmark_results *b_results, communicator world_comm, co
 #endif
 
 	/* Get initial value for system clock. */
-#pragma omp parallel for
-	for (j=0; j<*array_size; j++) {
-		a[j] = 1.0;
-		b[j] = 2.0;
-		c[j] = 0.0;
-	}
-
-	//if  ( (quantum = checktick()) >= 1)
-	//	printf("Your clock granularity/precision appears to be "
-	//			"%d microseconds.\n", quantum);
-	//else {
-	//	printf("Your clock granularity appears to be "
-	//			"less than one microsecond.\n");
-	//	quantum = 1;
-	//}
+	// The arrays are initialised with the fill kernel, which uses the same static
+	// decomposition across threads as the benchmark kernels.
+	run_kernel(arrays.kernels->fill, a, NULL, NULL, 1.0, array_size, type->size);
+	run_kernel(arrays.kernels->fill, b, NULL, NULL, 2.0, array_size, type->size);
+	run_kernel(arrays.kernels->fill, c, NULL, NULL, 0.0, array_size, type->size);
+	for(i=0; i<num_streams; i++){
+		run_kernel(arrays.kernels->fill, multi_streams[i], NULL, NULL, (i < settings.read_streams) ? 1.0 : 0.0, array_size, type->size);
+	}
+	if(indexed){
+		build_index(index, array_size, settings, world_comm.rank);
+	}
+
+	// Record where the pages of the arrays ended up now they have all been touched, summing
+	// the per process counts so the results describe the whole node.
+	for(i=0; i<MAX_NUMA_DOMAINS; i++){
+		b_results->numa_pages[i] = 0;
+	}
+	get_numa_placement(a, array_bytes, b_results->numa_pages, MAX_NUMA_DOMAINS);
+	get_numa_placement(b, array_bytes, b_results->numa_pages, MAX_NUMA_DOMAINS);
+	get_numa_placement(c, array_bytes, b_results->numa_pages, MAX_NUMA_DOMAINS);
+	MPI_Allreduce(MPI_IN_PLACE, b_results->numa_pages, MAX_NUMA_DOMAINS, MPI_DOUBLE, MPI_SUM, node_comm.comm);
+
+	// Likewise record how much of the arrays ended up on huge pages
+	coverage[0] = 0;
+	coverage[1] = 0;
+	get_page_coverage(a, array_bytes, &coverage[0], &coverage[1]);
+	get_page_coverage(b, array_bytes, &coverage[0], &coverage[1]);
+	get_page_coverage(c, array_bytes, &coverage[0], &coverage[1]);
+	MPI_Allreduce(MPI_IN_PLACE, coverage, 2, MPI_DOUBLE, MPI_SUM, node_comm.comm);
+	b_results->pages = settings.pages;
+	b_results->huge_page_bytes = coverage[0];
+	b_results->resident_bytes = coverage[1];
 
 	t = mysecond();
-#pragma omp parallel for
-	for (j = 0; j < *array_size; j++)
-		a[j] = 2.0E0 * a[j];
+	run_kernel(arrays.kernels->scale, c, a, NULL, 2.0E0, array_size, type->size);
 	t = 1.0E6 * (mysecond() - t);
 
 	//printf("Each test below will take on the order"
@@ -148,235 +279,529 @@ int stream_memory_task(benchmark_results *b_results, communicator world_comm, co
 	/*	--- MAIN LOOP --- repeat test cases repeats times --- */
 
 	scalar = 3.0;
-	for (k=0; k<repeats; k++)
-	{
-		// Add in a barrier synchronisation to ensure all processes on a node are undertaking the
-		// benchmark at the same time. This ensures the node level results are fair as all
-		// operations are synchronised on the node.
-		MPI_Barrier(node_comm.comm);
-		times[0][k] = mysecond();
-#pragma omp parallel for
-		for (j=0; j<*array_size; j++)
-			c[j] = a[j];
-		times[0][k] = mysecond() - times[0][k];
-		b_results->Copy.raw_result[k] = times[0][k];
-
-		MPI_Barrier(node_comm.comm);
-		times[1][k] = mysecond();
-#pragma omp parallel for
-		for (j=0; j<*array_size; j++)
-			b[j] = scalar*c[j];
-		times[1][k] = mysecond() - times[1][k];
-		b_results->Scale.raw_result[k] = times[1][k];
-
-		MPI_Barrier(node_comm.comm);
-		times[2][k] = mysecond();
-#pragma omp parallel for
-		for (j=0; j<*array_size; j++)
-			c[j] = a[j]+b[j];
-		times[2][k] = mysecond() - times[2][k];
-		b_results->Add.raw_result[k] = times[2][k];
-
-		MPI_Barrier(node_comm.comm);
-		times[3][k] = mysecond();
-#pragma omp parallel for
-		for (j=0; j<*array_size; j++)
-			a[j] = b[j]+scalar*c[j];
-		times[3][k] = mysecond() - times[3][k];
-		b_results->Triad.raw_result[k] = times[3][k];
+	arrays.a = a;
+	arrays.b = b;
+	arrays.c = c;
+	arrays.scalar = scalar;
+	arrays.array_size = array_size;
+	arrays.type = type;
+	arrays.index = index;
+	arrays.stride = settings.stride;
+	arrays.streams = (num_streams > 0) ? multi_streams : NULL;
+	arrays.read_streams = settings.read_streams;
+	arrays.write_streams = settings.write_streams;
+
+	b_results->array_size = array_size;
+	for (i=0; i<num_kernels; i++){
+		b_results->results[i].used = kernel_registry[i].enabled;
+		if(settings.thread_timing && b_results->results[i].used){
+			b_results->results[i].thread_raw_result = calloc((size_t)repeats * b_results->num_threads, sizeof(double));
+		}
+	}
+
+	state.warmups = 0;
+	state.stop = 0;
+	state.node_times = calloc(num_kernels, sizeof(running_stats));
+	b_results->repeats = 0;
+
+	record_thread_placement(b_results, 0);
+	state.start = mysecond();
+	if(settings.persistent_team){
+		// A single parallel region for the whole repeat loop. The master thread does all the MPI
+		// and the timing, and thread barriers keep the team in step around each kernel, which
+		// each thread runs on its own block of the arrays.
+#pragma omp parallel private(i, k)
+		{
+			for (k=0; k<repeats && !state.stop; k=next_k){
+				for (i=0; i<num_kernels; i++){
+					if(!b_results->results[i].used){
+						continue;
+					}
+#pragma omp master
+					{
+						MPI_Barrier(node_comm.comm);
+						if(settings.thread_timing){
+							set_thread_times(&b_results->results[i].thread_raw_result[k*b_results->num_threads]);
+						}
+						t = mysecond();
+					}
+#pragma omp barrier
+					kernel_registry[i].run(&arrays);
+#pragma omp barrier
+#pragma omp master
+					b_results->results[i].raw_result[k] = mysecond() - t;
+				}
+				// The whole team has to see the decision before testing the loop condition
+#pragma omp master
+				next_k = next_repeat(b_results, &state, settings, k, node_comm);
+#pragma omp barrier
+			}
+		}
+	}else{
+		for (k=0; k<repeats && !state.stop; k=next_repeat(b_results, &state, settings, k, node_comm))
+		{
+			for (i=0; i<num_kernels; i++){
+				if(!b_results->results[i].used){
+					continue;
+				}
+				// Add in a barrier synchronisation to ensure all processes on a node are undertaking the
+				// benchmark at the same time. This ensures the node level results are fair as all
+				// operations are synchronised on the node.
+				MPI_Barrier(node_comm.comm);
+				if(settings.thread_timing){
+					set_thread_times(&b_results->results[i].thread_raw_result[k*b_results->num_threads]);
+				}
+				t = mysecond();
+				kernel_registry[i].run(&arrays);
+				b_results->results[i].raw_result[k] = mysecond() - t;
+			}
+		}
+	}
+	set_thread_times(NULL);
+	free(state.node_times);
+
+	record_thread_placement(b_results, 1);
+
+	if(settings.target_confidence > 0 && settings.verbose){
+		MPI_Reduce(&b_results->repeats, &min_repeats, 1, MPI_INT, MPI_MIN, ROOT, world_comm.comm);
+		MPI_Reduce(&b_results->repeats, &max_repeats, 1, MPI_INT, MPI_MAX, ROOT, world_comm.comm);
+		if(world_comm.rank == ROOT){
+			printf("The nodes ran between %d and %d repeats.\n", min_repeats, max_repeats);
+		}
 	}
 
 	/*	--- SUMMARY --- */
-	/* note -- skip first iteration */
-	for (k=1; k<repeats; k++) {
-		b_results->Copy.avg = b_results->Copy.avg + times[0][k];
-		b_results->Copy.min = MIN(b_results->Copy.min, times[0][k]);
-		b_results->Copy.max = MAX(b_results->Copy.max, times[0][k]);
-		b_results->Scale.avg = b_results->Scale.avg + times[1][k];
-		b_results->Scale.min = MIN(b_results->Scale.min, times[1][k]);
-		b_results->Scale.max = MAX(b_results->Scale.max, times[1][k]);
-		b_results->Add.avg = b_results->Add.avg + times[2][k];
-		b_results->Add.min = MIN(b_results->Add.min, times[2][k]);
-		b_results->Add.max = MAX(b_results->Add.max, times[2][k]);
-		b_results->Triad.avg = b_results->Triad.avg + times[3][k];
-		b_results->Triad.min = MIN(b_results->Triad.min, times[3][k]);
-		b_results->Triad.max = MAX(b_results->Triad.max, times[3][k]);
-	}
-
-	b_results->Copy.avg = b_results->Copy.avg/(double)(repeats-1);
-	b_results->Scale.avg = b_results->Scale.avg/(double)(repeats-1);
-	b_results->Add.avg = b_results->Add.avg/(double)(repeats-1);
-	b_results->Triad.avg = b_results->Triad.avg/(double)(repeats-1);
+	summarise_benchmark_results(b_results, b_results->repeats);
 
 	/* --- Check Results --- */
-	checkSTREAMresults(*array_size, repeats);
+	// Timed separately so the cost of the validation is never mistaken for part of the benchmark
+	b_results->validation_time = -1;
+	if(settings.validation > 0){
+		t = mysecond();
+		// The arrays were also updated by the extra runs of the first repeat
+		checkSTREAMresults(b_results, type, array_size, b_results->repeats + state.warmups - 1, settings.validation);
+		if(num_streams > 0){
+			check_stream_results(type, multi_streams, settings.read_streams, settings.write_streams, array_size, settings.validation);
+		}
+		b_results->validation_time = mysecond() - t;
+	}
 
-	free(a);
-	free(b);
-	free(c);
+	free_array(a_base, allocated_bytes, settings);
+	free_array(b_base, allocated_bytes, settings);
+	free_array(c_base, allocated_bytes, settings);
+	if(indexed){
+		free_array(index, sizeof(size_t)*array_size, settings);
+	}
+	for(i=0; i<num_streams; i++){
+		free_array(multi_stream_bases[i], array_bytes + settings.alignment + i*shift, settings);
+	}
 
 	return 0;
 }
 
-# define	M	20
+// Fill the index array with a random permutation of the elements of the arrays, either of
+// individual elements or of blocks of contiguous elements. The identity is written in
+// parallel first so the pages of the index array are placed like the other arrays, and
+// each process uses a different seed.
+static void build_index(size_t *index, size_t array_size, task_settings settings, int seed){
+	unsigned long long state = 0x9E3779B97F4A7C15ULL ^ (unsigned long long)(seed + 1);
+	size_t block = (settings.distribution == blocked_index) ? settings.index_block : 1;
+	size_t num_blocks = (array_size + block - 1)/block;
+	size_t *order;
+	size_t i, j, k, temp;
+
+#pragma omp parallel
+	{
+		size_t start, length, l;
 
-static int checktick(){
-	int		i, minDelta, Delta;
-	double	t1, t2, timesfound[M];
+		get_thread_chunk(array_size, &start, &length);
+		for(l=start; l<start+length; l++){
+			index[l] = l;
+		}
+	}
+	if(num_blocks < 2){
+		return;
+	}
 
-	/*  Collect a sequence of M unique time values from the system. */
+	// Shuffle the order of the blocks (Fisher-Yates), then lay the blocks out in that order
+	if(block == 1){
+		order = index;
+	}else{
+		order = malloc(num_blocks * sizeof(size_t));
+		for(i=0; i<num_blocks; i++){
+			order[i] = i;
+		}
+	}
+	for(i=num_blocks-1; i>0; i--){
+		j = random_below(&state, i+1);
+		temp = order[i];
+		order[i] = order[j];
+		order[j] = temp;
+	}
+	if(block != 1){
+		k = 0;
+		for(i=0; i<num_blocks; i++){
+			for(j=order[i]*block; j<MIN((order[i]+1)*block, array_size); j++){
+				index[k] = j;
+				k++;
+			}
+		}
+		free(order);
+	}
+}
 
-	for (i = 0; i < M; i++) {
-		t1 = mysecond();
-		while( ((t2=mysecond()) - t1) < 1.0E-6 )
-			;
-		timesfound[i] = t1 = t2;
+// Record the CPU and socket each thread is running on, either at the start or the end of the
+// kernels. This uses a separate parallel region so it does not disturb the kernel timings, and
+// relies on the OpenMP runtime reusing the same threads for every parallel region.
+static void record_thread_placement(benchmark_results *b_results, int end){
+#pragma omp parallel
+	{
+		int chip, core;
+		int thread = omp_get_thread_num();
+
+		if(thread < b_results->num_threads){
+			get_processor_and_core(&chip, &core);
+			if(end){
+				b_results->threads[thread].end_cpu = core;
+				b_results->threads[thread].end_socket = chip;
+			}else{
+				b_results->threads[thread].start_cpu = core;
+				b_results->threads[thread].start_socket = chip;
+			}
+		}
 	}
+}
+
+// Allocate one of the task arrays using the requested NUMA placement. Without NUMA support
+// only first touch placement is possible, which is what malloc gives.
+// Older headers do not have the flags for choosing the hugetlb page size
+#ifndef MAP_HUGETLB
+#	define MAP_HUGETLB	0x40000
+#endif
+#ifndef MAP_HUGE_SHIFT
+#	define MAP_HUGE_SHIFT	26
+#endif
+#ifndef MAP_HUGE_2MB
+#	define MAP_HUGE_2MB	(21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#	define MAP_HUGE_1GB	(30 << MAP_HUGE_SHIFT)
+#endif
 
-	/*
-	 * Determine the minimum difference between these M values.
-	 * This result will be our estimate (in microseconds) for the
-	 * clock granularity.
-	 */
+#ifndef HUGETLBFS_MAGIC
+#	define HUGETLBFS_MAGIC	0x958458f6
+#endif
 
-	minDelta = 1000000;
-	for (i = 1; i < M; i++) {
-		Delta = (int)( 1.0E6 * (timesfound[i]-timesfound[i-1]));
-		minDelta = MIN(minDelta, MAX(Delta,0));
+#define HUGE_PAGE_2M	(2UL*1024*1024)
+#define HUGE_PAGE_1G	(1024UL*1024*1024)
+
+// The page size of a page mode, the mappings are a whole number of these
+static size_t page_mode_size(task_settings settings){
+	struct statfs fs;
+
+	switch(settings.pages){
+		case madvise_huge_pages:
+		case hugetlb_2m_pages:
+			return HUGE_PAGE_2M;
+		case hugetlb_1g_pages:
+			return HUGE_PAGE_1G;
+		case hugetlbfs_pages:
+			if(statfs(settings.hugetlbfs_path, &fs) == 0){
+				return fs.f_bsize;
+			}
+			return HUGE_PAGE_2M;
+		default:
+			return sysconf(_SC_PAGESIZE);
 	}
+}
 
-	return(minDelta);
+// Map an array with the pages of the page mode, returning MAP_FAILED if the pages are not available
+static void *map_array(size_t bytes, task_settings settings){
+	size_t page = page_mode_size(settings);
+	size_t length = ((bytes + page - 1)/page)*page;
+	char file_name[MAX_FILE_NAME_LENGTH];
+	char *array, *aligned;
+	struct statfs fs;
+	int fd;
+
+	switch(settings.pages){
+		case small_pages:
+			array = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_NOHUGEPAGE
+			if(array != MAP_FAILED){
+				madvise(array, length, MADV_NOHUGEPAGE);
+			}
+#endif
+			break;
+		case madvise_huge_pages:
+			// Map an extra huge page so the array can start on a huge page boundary, then
+			// give back the unused ends
+			array = mmap(NULL, length + page, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+			if(array != MAP_FAILED){
+				aligned = (char *)(((uintptr_t)array + page - 1) & ~(uintptr_t)(page - 1));
+				if(aligned > array){
+					munmap(array, aligned - array);
+				}
+				munmap(aligned + length, page - (aligned - array));
+				array = aligned;
+#ifdef MADV_HUGEPAGE
+				madvise(array, length, MADV_HUGEPAGE);
+#endif
+			}
+			break;
+		case hugetlb_2m_pages:
+			array = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|MAP_HUGE_2MB, -1, 0);
+			break;
+		case hugetlb_1g_pages:
+			array = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|MAP_HUGE_1GB, -1, 0);
+			break;
+		case hugetlbfs_pages:
+			// Files anywhere else would silently be on normal pages
+			if(statfs(settings.hugetlbfs_path, &fs) != 0 || fs.f_type != HUGETLBFS_MAGIC){
+				return MAP_FAILED;
+			}
+			snprintf(file_name, MAX_FILE_NAME_LENGTH, "%s/distributedstream.XXXXXX", settings.hugetlbfs_path);
+			fd = mkstemp(file_name);
+			if(fd < 0){
+				return MAP_FAILED;
+			}
+			// The file is only needed until it is mapped, its pages are freed when the mapping is
+			unlink(file_name);
+			if(ftruncate(fd, length) == 0){
+				array = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+			}else{
+				array = MAP_FAILED;
+			}
+			close(fd);
+			break;
+		default:
+			return MAP_FAILED;
+	}
+
+#ifdef NUMA
+	// The placement has to be set before the pages are first touched
+	if(array != MAP_FAILED){
+		switch(settings.placement){
+			case local_placement:
+				numa_setlocal_memory(array, length);
+				break;
+			case interleaved_placement:
+				numa_interleave_memory(array, length, numa_all_nodes_ptr);
+				break;
+			case node_placement:
+				numa_tonode_memory(array, length, settings.placement_node);
+				break;
+			default:
+				break;
+		}
+	}
+#endif
+
+	return array;
 }
 
+static void *allocate_array(size_t bytes, task_settings settings){
+	void *array;
 
+	if(settings.pages != default_pages){
+		array = map_array(bytes, settings);
+		if(array == MAP_FAILED){
+			printf("Unable to allocate %zu bytes with %s pages, check the huge pages available on the node.\n", bytes, page_mode_name(settings.pages));
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		return array;
+	}
+#ifdef NUMA
+	switch(settings.placement){
+		case local_placement:
+			return numa_alloc_local(bytes);
+		case interleaved_placement:
+			return numa_alloc_interleaved(bytes);
+		case node_placement:
+			return numa_alloc_onnode(bytes, settings.placement_node);
+		default:
+			break;
+	}
+#endif
+	return malloc(bytes);
+}
 
-/* A gettimeofday routine to give access to the wall
-   clock timer on most UNIX-like systems.  */
-static double mysecond(){
-	struct timeval tp;
-	struct timezone tzp;
-	int i;
+// Start an array shift bytes after the first alignment boundary of its allocation, the
+// alignment being a power of two (or zero to keep the alignment of the allocation)
+static void *place_array(void *base, size_t alignment, size_t shift){
+	uintptr_t start = (uintptr_t)base;
 
-	i = gettimeofday(&tp,&tzp);
-	return ( (double) tp.tv_sec + (double) tp.tv_usec * 1.e-6 );
+	if(alignment > 0){
+		start = (start + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	}
+	return (void *)(start + shift);
 }
 
-#ifndef abs
-#define abs(a) ((a) >= 0 ? (a) : -(a))
-#endif
-static void checkSTREAMresults (int array_size, int repeats){
-	STREAM_TYPE aj,bj,cj,scalar;
-	STREAM_TYPE aSumErr,bSumErr,cSumErr;
-	STREAM_TYPE aAvgErr,bAvgErr,cAvgErr;
-	double epsilon;
-	ssize_t	j;
-	int	k,ierr,err;
+static void free_array(void *array, size_t bytes, task_settings settings){
+	size_t page;
 
-	/* reproduce initialization */
-	aj = 1.0;
-	bj = 2.0;
-	cj = 0.0;
-	/* a[] is modified during timing check */
-	aj = 2.0E0 * aj;
-	/* now execute timing loop */
-	scalar = 3.0;
-	for (k=0; k<repeats; k++)
-	{
-		cj = aj;
-		bj = scalar*cj;
-		cj = aj+bj;
-		aj = bj+scalar*cj;
+	if(settings.pages != default_pages){
+		page = page_mode_size(settings);
+		munmap(array, ((bytes + page - 1)/page)*page);
+		return;
+	}
+#ifdef NUMA
+	if(settings.placement != first_touch){
+		numa_free(array, bytes);
+		return;
 	}
+#endif
+	free(array);
+}
 
-	/* accumulate deltas between observed and expected results */
-	aSumErr = 0.0;
-	bSumErr = 0.0;
-	cSumErr = 0.0;
-	for (j=0; j<array_size; j++) {
-		aSumErr += abs(a[j] - aj);
-		bSumErr += abs(b[j] - bj);
-		cSumErr += abs(c[j] - cj);
-		// if (j == 417) printf("Index 417: c[j]: %f, cj: %f\n",c[j],cj);	// MCCALPIN
+
+// Set a single element of the given type to a value, using the scalar fill kernel
+static void fill_value(data_type *type, void *element, double value){
+	type->kernel_sets[type->num_kernel_sets-1].fill(element, NULL, NULL, value, 1);
+}
+
+// Decide which repeat to run after repeat k. The first repeat (which is not counted) is run
+// settings.warmup times. In the adaptive mode each kernel's node time (that of the slowest
+// process on the node) is added to its statistics after every counted repeat, and the loop
+// stops once the confidence interval of every kernel is within the target or the time budget
+// has been spent. The processes of a node all reduce the same times, including the time spent,
+// so they reach the same decision and stay in step.
+static int next_repeat(benchmark_results *b_results, repeat_state *state, task_settings settings, int k, communicator node_comm){
+	double times[num_kernels+1];
+	int i, converged;
+
+	if(k == 0 && ++state->warmups < settings.warmup){
+		return 0;
+	}
+	k++;
+	b_results->repeats = k;
+	if(settings.target_confidence <= 0 || k < 2){
+		return k;
 	}
-	aAvgErr = aSumErr / (STREAM_TYPE) array_size;
-	bAvgErr = bSumErr / (STREAM_TYPE) array_size;
-	cAvgErr = cSumErr / (STREAM_TYPE) array_size;
 
-	if (sizeof(STREAM_TYPE) == 4) {
-		epsilon = 1.e-6;
+	for(i=0; i<num_kernels; i++){
+		times[i] = b_results->results[i].used ? b_results->results[i].raw_result[k-1] : 0;
 	}
-	else if (sizeof(STREAM_TYPE) == 8) {
-		epsilon = 1.e-13;
+	times[num_kernels] = mysecond() - state->start;
+	MPI_Allreduce(MPI_IN_PLACE, times, num_kernels+1, MPI_DOUBLE, MPI_MAX, node_comm.comm);
+
+	converged = 1;
+	for(i=0; i<num_kernels; i++){
+		if(!b_results->results[i].used){
+			continue;
+		}
+		running_stats_add(&state->node_times[i], times[i]);
+		if(state->node_times[i].count < MIN_ADAPTIVE_REPEATS || relative_confidence(&state->node_times[i]) > settings.target_confidence){
+			converged = 0;
+		}
 	}
-	else {
-		printf("WEIRD: sizeof(STREAM_TYPE) = %lu\n",sizeof(STREAM_TYPE));
-		epsilon = 1.e-6;
+	if(converged || (settings.time_budget > 0 && times[num_kernels] >= settings.time_budget)){
+		state->stop = 1;
 	}
 
+	return k;
+}
+
+static void checkSTREAMresults (benchmark_results *b_results, data_type *type, size_t array_size, int repeats, size_t sample){
+	// Storage for a single element of any of the element types
+	long double complex aj,bj,cj;
+	double aAvgErr,bAvgErr,cAvgErr;
+	double scalar;
+	size_t aerr,berr,cerr;
+	int	err;
+
+	/* reproduce initialization */
+	fill_value(type, &aj, 1.0);
+	fill_value(type, &bj, 2.0);
+	fill_value(type, &cj, 0.0);
+	/* c[] is modified during timing check */
+	fill_value(type, &cj, 2.0);
+	/* now execute timing loop */
+	scalar = 3.0;
+	expected_values(type, b_results->results, repeats, scalar, &aj, &bj, &cj);
+
+	/* accumulate deltas between observed and expected results */
+	aAvgErr = validate_array(type, a, &aj, array_size, sample, &aerr);
+	bAvgErr = validate_array(type, b, &bj, array_size, sample, &berr);
+	cAvgErr = validate_array(type, c, &cj, array_size, sample, &cerr);
+
 	err = 0;
-	if (abs(aAvgErr/aj) > epsilon) {
+	if (aAvgErr > type->epsilon) {
 		err++;
-		printf ("Failed Validation on array a[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",aj,aAvgErr,abs(aAvgErr)/aj);
-		ierr = 0;
-		for (j=0; j<array_size; j++) {
-			if (abs(a[j]/aj-1.0) > epsilon) {
-				ierr++;
-#ifdef VERBOSE
-				if (ierr < 10) {
-					printf("         array a: index: %ld, expected: %e, observed: %e, relative error: %e\n",
-							j,aj,a[j],abs((aj-a[j])/aAvgErr));
-				}
-#endif
-			}
-		}
-		printf("     For array a[], %d errors were found.\n",ierr);
+		printf ("Failed Validation on array a[], AvgRelAbsErr > epsilon (%e)\n",type->epsilon);
+		printf ("     AvgRelAbsErr: %e\n",aAvgErr);
+		printf("     For array a[], %zu errors were found.\n",aerr);
 	}
-	if (abs(bAvgErr/bj) > epsilon) {
+	if (bAvgErr > type->epsilon) {
 		err++;
-		printf ("Failed Validation on array b[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",bj,bAvgErr,abs(bAvgErr)/bj);
-		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
-		ierr = 0;
-		for (j=0; j<array_size; j++) {
-			if (abs(b[j]/bj-1.0) > epsilon) {
-				ierr++;
-#ifdef VERBOSE
-				if (ierr < 10) {
-					printf("         array b: index: %ld, expected: %e, observed: %e, relative error: %e\n",
-							j,bj,b[j],abs((bj-b[j])/bAvgErr));
-				}
-#endif
-			}
-		}
-		printf("     For array b[], %d errors were found.\n",ierr);
+		printf ("Failed Validation on array b[], AvgRelAbsErr > epsilon (%e)\n",type->epsilon);
+		printf ("     AvgRelAbsErr: %e\n",bAvgErr);
+		printf("     For array b[], %zu errors were found.\n",berr);
 	}
-	if (abs(cAvgErr/cj) > epsilon) {
+	if (cAvgErr > type->epsilon) {
 		err++;
-		printf ("Failed Validation on array c[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",cj,cAvgErr,abs(cAvgErr)/cj);
-		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
-		ierr = 0;
-		for (j=0; j<array_size; j++) {
-			if (abs(c[j]/cj-1.0) > epsilon) {
-				ierr++;
-#ifdef VERBOSE
-				if (ierr < 10) {
-					printf("         array c: index: %ld, expected: %e, observed: %e, relative error: %e\n",
-							j,cj,c[j],abs((cj-c[j])/cAvgErr));
-				}
-#endif
-			}
-		}
-		printf("     For array c[], %d errors were found.\n",ierr);
+		printf ("Failed Validation on array c[], AvgRelAbsErr > epsilon (%e)\n",type->epsilon);
+		printf ("     AvgRelAbsErr: %e\n",cAvgErr);
+		printf("     For array c[], %zu errors were found.\n",cerr);
 	}
 
 #ifdef VERBOSE
 	printf ("Results Validation Verbose Results: \n");
-	printf ("    Expected a(1), b(1), c(1): %f %f %f \n",aj,bj,cj);
-	printf ("    Observed a(1), b(1), c(1): %f %f %f \n",a[1],b[1],c[1]);
-	printf ("    Rel Errors on a, b, c:     %e %e %e \n",abs(aAvgErr/aj),abs(bAvgErr/bj),abs(cAvgErr/cj));
+	printf ("    Rel Errors on a, b, c:     %e %e %e \n",aAvgErr,bAvgErr,cAvgErr);
 #endif
 }
 
+// Every array written by the stream count kernel should hold the sum of the read arrays,
+// which are all ones
+static void check_stream_results(data_type *type, void **arrays, int reads, int writes, size_t array_size, size_t sample){
+	long double complex expected;
+	double avg_error;
+	size_t errors;
+	int s;
+
+	fill_value(type, &expected, (double)reads);
+	for(s=reads; s<reads+writes; s++){
+		avg_error = validate_array(type, arrays[s], &expected, array_size, sample, &errors);
+		if(avg_error > type->epsilon){
+			printf("Failed Validation on stream count array %d, AvgRelAbsErr > epsilon (%e)\n", s-reads, type->epsilon);
+			printf("     AvgRelAbsErr: %e\n", avg_error);
+			printf("     For stream count array %d, %zu errors were found.\n", s-reads, errors);
+		}
+	}
+}
+
+// The number of empty parallel regions, and of barriers, timed to measure their cost
+#define TEAM_OVERHEAD_REPEATS 1000
+
+static volatile int team_overhead_sink;
 
+// Measure the cost, in seconds, of starting and finishing a parallel region (the fork/join
+// each kernel pays when it opens its own region) and of a barrier across the team (what each
+// kernel pays instead in the persistent team mode)
+static void measure_team_overheads(double *fork_join, double *barrier){
+	double t;
+	int k;
+
+	t = mysecond();
+	for(k=0; k<TEAM_OVERHEAD_REPEATS; k++){
+		// The region has to do something, or the compiler can remove it
+#pragma omp parallel
+		{
+#pragma omp master
+			team_overhead_sink = k;
+		}
+	}
+	*fork_join = (mysecond() - t)/TEAM_OVERHEAD_REPEATS;
+
+#pragma omp parallel private(k)
+	{
+#pragma omp barrier
+#pragma omp master
+		t = mysecond();
+		for(k=0; k<TEAM_OVERHEAD_REPEATS; k++){
+#pragma omp barrier
+		}
+#pragma omp master
+		*barrier = (mysecond() - t)/TEAM_OVERHEAD_REPEATS;
+	}
+}
@@ -0,0 +1,160 @@
+#include "definitions.h"
+#include <time.h>
+#if defined(CYCLE_TIMER) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+
+/*-----------------------------------------------------------------------
+ * The timer used by all the tasks.
+ *
+ *	By default this is clock_gettime with CLOCK_MONOTONIC_RAW, which has
+ *	nanosecond resolution, is not adjusted by NTP, and is read through
+ *	the vDSO without a system call on Linux. Building with CYCLE_TIMER
+ *	defined reads the processor's counter instead: the invariant TSC on
+ *	x86 (calibrated against the clock at startup, and only used if the
+ *	processor reports it as invariant) or the virtual counter
+ *	(cntvct_el0) on Arm, whose frequency is given by cntfrq_el0. The
+ *	counter is cheaper to read, which matters for the short kernels of
+ *	sweeps and of nodes with many processes.
+ *
+ *	The resolution and the overhead of a call are measured by init_timer
+ *	so they can be reported with the results.
+ *-----------------------------------------------------------------------*/
+
+#ifdef CLOCK_MONOTONIC_RAW
+#	define TIMER_CLOCK	CLOCK_MONOTONIC_RAW
+#	define TIMER_CLOCK_NAME	"clock_gettime(CLOCK_MONOTONIC_RAW)"
+#else
+#	define TIMER_CLOCK	CLOCK_MONOTONIC
+#	define TIMER_CLOCK_NAME	"clock_gettime(CLOCK_MONOTONIC)"
+#endif
+
+// How long to calibrate the cycle counter against the clock for, in seconds
+#define CALIBRATION_TIME	0.05
+// Number of back to back calls used to measure the overhead of the timer
+#define OVERHEAD_CALLS	100000
+// Number of distinct ticks used to measure the resolution of the timer
+#define RESOLUTION_TICKS	20
+
+#if defined(CYCLE_TIMER) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+static int use_counter = 0;
+static unsigned long long counter_base = 0;
+static double seconds_per_count = 0;
+#endif
+static double resolution = 0;
+static double overhead = 0;
+static char *name = TIMER_CLOCK_NAME;
+
+static double clock_seconds(){
+	struct timespec tp;
+
+	clock_gettime(TIMER_CLOCK, &tp);
+	return ( (double) tp.tv_sec + (double) tp.tv_nsec * 1.e-9 );
+}
+
+#if defined(CYCLE_TIMER) && (defined(__x86_64__) || defined(__i386__))
+static inline unsigned long long read_counter(){
+	return __rdtsc();
+}
+
+// The TSC only counts at a constant rate, whatever the core frequency, if it is invariant
+static int counter_available(){
+	unsigned int eax, ebx, ecx, edx;
+
+	if(!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)){
+		return 0;
+	}
+	return (edx & (1 << 8)) != 0;
+}
+
+static double counter_frequency(){
+	unsigned long long c0, c1;
+	double t0, t1;
+
+	t0 = clock_seconds();
+	c0 = read_counter();
+	do {
+		t1 = clock_seconds();
+	} while(t1 - t0 < CALIBRATION_TIME);
+	c1 = read_counter();
+	return (c1 - c0)/(t1 - t0);
+}
+#elif defined(CYCLE_TIMER) && defined(__aarch64__)
+static inline unsigned long long read_counter(){
+	unsigned long long value;
+
+	__asm__ volatile("isb; mrs %0, cntvct_el0" : "=r" (value) : : "memory");
+	return value;
+}
+
+static int counter_available(){
+	return 1;
+}
+
+static double counter_frequency(){
+	unsigned long long frequency;
+
+	__asm__ volatile("mrs %0, cntfrq_el0" : "=r" (frequency));
+	return (double)frequency;
+}
+#endif
+
+// Choose the timer and measure its resolution and overhead. This should be called by every
+// process before any timing is done.
+void init_timer(){
+	double t1, t2, min_delta;
+	int i;
+
+#if defined(CYCLE_TIMER) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+	if(counter_available()){
+		seconds_per_count = 1.0/counter_frequency();
+		// Count from now, so the values stay small enough to keep their precision as doubles
+		counter_base = read_counter();
+		use_counter = 1;
+#if defined(__aarch64__)
+		name = "cntvct_el0 counter";
+#else
+		name = "invariant TSC";
+#endif
+	}
+#endif
+
+	// The resolution is the smallest step seen between successive different values
+	min_delta = 1.0;
+	for(i=0; i<RESOLUTION_TICKS; i++){
+		t1 = mysecond();
+		while((t2 = mysecond()) == t1)
+			;
+		min_delta = MIN(min_delta, t2 - t1);
+	}
+	resolution = min_delta;
+
+	t1 = mysecond();
+	for(i=0; i<OVERHEAD_CALLS; i++){
+		t2 = mysecond();
+	}
+	overhead = (mysecond() - t1)/OVERHEAD_CALLS;
+}
+
+// The current time in seconds from an arbitrary starting point
+double mysecond(){
+#if defined(CYCLE_TIMER) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+	if(use_counter){
+		return (double)(read_counter() - counter_base) * seconds_per_count;
+	}
+#endif
+	return clock_seconds();
+}
+
+char *timer_name(){
+	return name;
+}
+
+double timer_resolution(){
+	return resolution;
+}
+
+double timer_overhead(){
+	return overhead;
+}
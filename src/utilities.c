@@ -1,82 +1,100 @@
+// Needed for sched_getcpu when building with NUMA support
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include "utilities.h"
+#include <sched.h>
 
-// The routine convert a string (name) into a number
-// for use in a MPI_Comm_split call (where the number is
-// known as a colour). It is effectively a hashing function
-// for strings but is not necessarily robust (i.e. does not
-// guarantee it is collision free) for all strings, but it
-// should be reasonable for strings that different by small
-// amounts (i.e the name of nodes where they different by a
-// number of set of numbers and letters, for instance
-// login01,login02..., or cn01q94,cn02q43, etc...)
-/*int name_to_colour(const char *name){
-  int res;
-  int small_multiplier = 5;
-  int large_multiplier = 1l;
-  const char *p;
-
-  res = 0;
-  for(p=name; *p ; p++){
-    // Guard against integer overflow.
-    if (small_multiplier > 0 && (res * small_multiplier) > (INT_MAX / small_multiplier)) {
-      // If overflow looks likely (due to the calculation above) then
-      // simply flip the result to make it negative
-      res = -res;
-    }else{
-      // If overflow is not going to happen then undertake the calculation
-      res = (small_multiplier * res);
+// The name of the node, or part of the node, the node communicator of this process covers.
+// Set by get_node_comm.
+static char node_name[MPI_MAX_PROCESSOR_NAME];
+
+// Whether this process is bound to a subset of the CPUs of the node
+static int process_is_bound(){
+
+  cpu_set_t mask;
+
+  if(sched_getaffinity(0, sizeof(mask), &mask) != 0){
+    return 0;
+  }
+  return CPU_COUNT(&mask) < get_nprocs();
+
+}
+
+// Create the node communicator for this process, containing all the processes that can share
+// memory with it. This is built with MPI_Comm_split_type, so unlike splitting on a hash of the
+// processor name two nodes can never be merged into one communicator. With a socket or NUMA
+// scope the node is split further, into a communicator per socket or NUMA domain, using the
+// hardware guided split of the MPI library where it has one (MPI 4, or Open MPI's own types).
+// If that is not available on every process of the node, the processes are split on the socket
+// or NUMA domain they are running on, so they should be bound to cores. The part of the node
+// is numbered from 0 on each node and added to the node name.
+MPI_Comm get_node_comm(node_scope scope){
+
+  MPI_Comm host_comm, node_comm = MPI_COMM_NULL;
+  char suffix[32];
+  int len, available, all_available;
+  int rank, leader, index;
+  int chip, core, domain;
+#if MPI_VERSION >= 4
+  MPI_Info info;
+#endif
+
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &host_comm);
+  MPI_Get_processor_name(node_name, &len);
+  if(scope == whole_node){
+    return host_comm;
+  }
+
+#if MPI_VERSION >= 4
+  MPI_Info_create(&info);
+  MPI_Info_set(info, "mpi_hw_resource_type", (scope == socket_domain) ? "Package" : "NUMANode");
+  MPI_Comm_split_type(host_comm, MPI_COMM_TYPE_HW_GUIDED, 0, info, &node_comm);
+  MPI_Info_free(&info);
+#elif defined(OPEN_MPI)
+  MPI_Comm_split_type(host_comm, (scope == socket_domain) ? OMPI_COMM_TYPE_SOCKET : OMPI_COMM_TYPE_NUMA, 0, MPI_INFO_NULL, &node_comm);
+#endif
+  // The hardware guided split leaves out (or isolates) processes that are not bound within a
+  // single socket or domain, in which case the whole node uses the fallback
+  available = (node_comm != MPI_COMM_NULL) && process_is_bound();
+  MPI_Allreduce(&available, &all_available, 1, MPI_INT, MPI_MIN, host_comm);
+  if(!all_available){
+    if(node_comm != MPI_COMM_NULL){
+      MPI_Comm_free(&node_comm);
     }
-    // Add on the new character here.
-    res = res + *p;
-    res = res % large_multiplier;
-    printf("%c %d\n",*p,res);
-  }
-  // If we have ended up with a negative result, invert it to make it positive because
-  // the functionality (in MPI) that we will use this for requires the int to be positive.
-  if( res < 0 ){
-    res = -res;
-  }
-  return res;
-}*/
-
-// The routine convert a string (name) into a number
-// for use in a MPI_Comm_split call (where the number is
-// known as a colour). It is effectively a hashing function
-// for strings but is not necessarily robust (i.e. does not
-// guarantee it is collision free) for all strings, but it
-// should be reasonable for strings that different by small
-// amounts (i.e the name of nodes where they different by a
-// number of set of numbers and letters, for instance
-// login01,login02..., or cn01q94,cn02q43, etc...)
-int name_to_colour(const char *name) {
-    int small_multiplier = 31;
-    int large_multiplier = 1e9 + 9;
-    int res = 0;
-    int power = 1;
-    const char *p;
-    for(p=name; *p ; p++){
-        res = (res + (*p + 1) * power) % large_multiplier;
-	if(res < 0){
-		res = - res;
-	}
-	power = (power * small_multiplier) % large_multiplier;
+    if(scope == socket_domain){
+      get_processor_and_core(&chip, &core);
+      domain = chip;
+    }else{
+      domain = get_numa_domain();
     }
-    return res;
-}
+    MPI_Comm_split(host_comm, domain, 0, &node_comm);
+  }
 
-// Get an integer key for a process based on the name of the
-// node this process is running on. This is useful for creating
-// communicators for all the processes running on a node.
-int get_key(){
+  // Number the parts of the node in the order of their first processes
+  MPI_Comm_rank(node_comm, &rank);
+  leader = (rank == 0);
+  index = 0;
+  MPI_Exscan(&leader, &index, 1, MPI_INT, MPI_SUM, host_comm);
+  MPI_Comm_rank(host_comm, &rank);
+  if(rank == 0){
+    index = 0;
+  }
+  MPI_Bcast(&index, 1, MPI_INT, 0, node_comm);
+  snprintf(suffix, sizeof(suffix), ":%s%d", (scope == socket_domain) ? "socket" : "numa", index);
+  if(strlen(node_name) + strlen(suffix) < MPI_MAX_PROCESSOR_NAME){
+    strcat(node_name, suffix);
+  }
 
-  char name[MPI_MAX_PROCESSOR_NAME];
-  int len;
-  int lpar_key;
+  MPI_Comm_free(&host_comm);
+  return node_comm;
 
-  MPI_Get_processor_name(name, &len);
-  lpar_key = name_to_colour(name);
-  return lpar_key;
+}
 
+// The name of the node (or part of a node) this process is on, as used in the results. This
+// must only be called after get_node_comm.
+void get_node_name(char *name){
+  strcpy(name, node_name);
 }
 
 #if defined(__aarch64__)
@@ -99,3 +117,316 @@ unsigned long get_processor_and_core(int *chip, int *core){
   return ((unsigned long)a) | (((unsigned long)d) << 32);;
 }
 #endif
+
+// A random number in [0,n) from a xorshift64* generator, which is plenty for shuffling
+// arrays and gives the same sequence on every system so runs can be repeated. The
+// state must not be zero.
+size_t random_below(unsigned long long *state, size_t n){
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return (size_t)((*state * 2685821657736338717ULL) % n);
+}
+
+// Add a value to the running statistics using Welford's method, which does not lose precision
+// when the spread of the values is small compared to their mean
+void running_stats_add(running_stats *stats, double value){
+  double delta;
+
+  stats->count++;
+  delta = value - stats->mean;
+  stats->mean = stats->mean + delta/stats->count;
+  stats->m2 = stats->m2 + delta*(value - stats->mean);
+}
+
+// The sample variance of the values added so far
+double running_stats_variance(running_stats *stats){
+  if(stats->count < 2){
+    return 0;
+  }
+  return stats->m2/(stats->count - 1);
+}
+
+// Two sided 95% critical values of Student's t distribution for 1 to 30 degrees of freedom
+static const double t_critical[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                      2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                      2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+// Half the width of the 95% confidence interval of the mean, relative to the mean, or zero if
+// there are fewer than two values. Beyond 30 degrees of freedom the critical value is close
+// enough to 1.96 + 2.4/df.
+double relative_confidence(running_stats *stats){
+  int df = stats->count - 1;
+  double t;
+
+  if(df < 1 || stats->mean <= 0){
+    return 0;
+  }
+  t = (df <= 30) ? t_critical[df-1] : 1.96 + 2.4/df;
+  return t*sqrt(running_stats_variance(stats)/stats->count)/stats->mean;
+}
+
+// Count a value in a sketch of SKETCH_BUCKETS counts. Bucket i holds the values in
+// (SKETCH_MIN_VALUE*gamma^(i-1), SKETCH_MIN_VALUE*gamma^i], with gamma set by the accuracy.
+void sketch_add(double *sketch, double value){
+  double gamma = (1.0 + SKETCH_ACCURACY)/(1.0 - SKETCH_ACCURACY);
+  int bucket = 0;
+
+  if(value > SKETCH_MIN_VALUE){
+    bucket = (int)ceil(log(value/SKETCH_MIN_VALUE)/log(gamma));
+  }
+  if(bucket > SKETCH_BUCKETS-1){
+    bucket = SKETCH_BUCKETS-1;
+  }
+  sketch[bucket] += 1;
+}
+
+// The value at quantile q (0 to 1) of the values counted in a sketch, or 0 if it is empty
+double sketch_quantile(double *sketch, double q){
+  double gamma = (1.0 + SKETCH_ACCURACY)/(1.0 - SKETCH_ACCURACY);
+  double total = 0, rank, seen;
+  int i;
+
+  for(i=0; i<SKETCH_BUCKETS; i++){
+    total = total + sketch[i];
+  }
+  if(total <= 0){
+    return 0;
+  }
+  rank = q*(total - 1);
+  seen = 0;
+  for(i=0; i<SKETCH_BUCKETS-1; i++){
+    seen = seen + sketch[i];
+    if(seen > rank){
+      break;
+    }
+  }
+  // The middle of the bucket in relative terms, which is within the accuracy of all its values
+  return SKETCH_MIN_VALUE*2.0*pow(gamma, i)/(gamma + 1.0);
+}
+
+#define SYSFS_VALUE_LENGTH 256
+
+// Read a single line from a sysfs file into value, returning 0 on success
+static int read_sysfs_value(const char *path, char *value, int length){
+  FILE *fp;
+  int err = 1;
+
+  fp = fopen(path, "r");
+  if(fp == NULL){
+    return 1;
+  }
+  if(fgets(value, length, fp) != NULL){
+    value[strcspn(value, "\n")] = '\0';
+    err = 0;
+  }
+  fclose(fp);
+  return err;
+}
+
+// Get the total size, in bytes, of the last level of cache on the node this process
+// is running on. This is found from the cache descriptions in sysfs, adding together
+// every distinct instance of the highest level of data cache (i.e. one L3 per socket
+// or per core complex). If sysfs is not available sysconf is used instead, although
+// that only gives the size of a single cache instance. Returns 0 if neither works.
+size_t get_llc_size(){
+
+  char path[SYSFS_VALUE_LENGTH];
+  char value[SYSFS_VALUE_LENGTH];
+  char (*instances)[SYSFS_VALUE_LENGTH] = NULL;
+  int num_instances = 0;
+  int max_level = 0;
+  int level, cpu, index, i, found;
+  long num_cpus;
+  size_t size;
+  size_t total = 0;
+  char unit;
+
+  num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+  instances = malloc(num_cpus * sizeof(*instances));
+
+  for(cpu=0; cpu<num_cpus; cpu++){
+    for(index=0; ; index++){
+      sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+      if(read_sysfs_value(path, value, SYSFS_VALUE_LENGTH) != 0){
+        break;
+      }
+      level = atoi(value);
+      sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/type", cpu, index);
+      if(read_sysfs_value(path, value, SYSFS_VALUE_LENGTH) != 0 || strcmp(value, "Instruction") == 0 || level < max_level){
+        continue;
+      }
+      sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/size", cpu, index);
+      if(read_sysfs_value(path, value, SYSFS_VALUE_LENGTH) != 0){
+        continue;
+      }
+      unit = '\0';
+      if(sscanf(value, "%zu%c", &size, &unit) < 1){
+        continue;
+      }
+      if(unit == 'K'){
+        size = size*1024;
+      }else if(unit == 'M'){
+        size = size*1024*1024;
+      }else if(unit == 'G'){
+        size = size*1024*1024*1024;
+      }
+      // A higher level of cache than seen so far replaces everything found before
+      if(level > max_level){
+        max_level = level;
+        num_instances = 0;
+        total = 0;
+      }
+      // Caches shared between cores appear under every core that shares them, so only
+      // count each instance once, identified by the list of cores sharing it.
+      sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+      if(read_sysfs_value(path, value, SYSFS_VALUE_LENGTH) != 0){
+        sprintf(value, "%d", cpu);
+      }
+      found = 0;
+      for(i=0; i<num_instances; i++){
+        if(strcmp(instances[i], value) == 0){
+          found = 1;
+          break;
+        }
+      }
+      if(!found && num_instances < num_cpus){
+        strcpy(instances[num_instances], value);
+        num_instances++;
+        total = total + size;
+      }
+    }
+  }
+
+  free(instances);
+
+  if(total == 0){
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    if(sysconf(_SC_LEVEL3_CACHE_SIZE) > 0){
+      total = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    }else if(sysconf(_SC_LEVEL2_CACHE_SIZE) > 0){
+      total = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    }
+#endif
+  }
+
+  return total;
+
+}
+
+#ifdef NUMA
+// The NUMA domain of the CPU the calling thread is running on
+int get_numa_domain(){
+  return numa_node_of_cpu(sched_getcpu());
+}
+
+// The number of NUMA domains on this node, or 1 if NUMA is not available
+int get_num_numa_domains(){
+  if(numa_available() < 0){
+    return 1;
+  }
+  return numa_max_node() + 1;
+}
+
+// Whether a NUMA domain has any memory, domains with only CPUs cannot have arrays placed on them
+int numa_domain_has_memory(int domain){
+  if(numa_available() < 0){
+    return domain == 0;
+  }
+  return numa_node_size64(domain, NULL) > 0;
+}
+
+// Find which NUMA domains the pages of an array are on, adding the number of pages found on
+// each domain to numa_pages. Large arrays are sampled, rather than every page being checked,
+// to keep the cost of this down.
+#define MAX_SAMPLED_PAGES 1024
+void get_numa_placement(void *array, size_t bytes, double *numa_pages, int max_domains){
+  void *pages[MAX_SAMPLED_PAGES];
+  int status[MAX_SAMPLED_PAGES];
+  long page_size = sysconf(_SC_PAGESIZE);
+  size_t num_pages = (bytes + page_size - 1)/page_size;
+  size_t stride = (num_pages + MAX_SAMPLED_PAGES - 1)/MAX_SAMPLED_PAGES;
+  unsigned long count = 0;
+  size_t page;
+  unsigned long i;
+
+  if(numa_available() < 0 || stride == 0){
+    return;
+  }
+  for(page=0; page<num_pages && count<MAX_SAMPLED_PAGES; page+=stride){
+    pages[count] = (char *)array + page*page_size;
+    count++;
+  }
+  // Passing no target nodes makes move_pages report where each page is rather than move it
+  if(numa_move_pages(0, count, pages, NULL, status, 0) != 0){
+    return;
+  }
+  for(i=0; i<count; i++){
+    if(status[i] >= 0 && status[i] < max_domains){
+      numa_pages[status[i]] += 1;
+    }
+  }
+}
+#else
+int get_numa_domain(){
+  return 0;
+}
+
+int get_num_numa_domains(){
+  return 1;
+}
+
+int numa_domain_has_memory(int domain){
+  return domain == 0;
+}
+
+void get_numa_placement(void *array, size_t bytes, double *numa_pages, int max_domains){
+  return;
+}
+#endif
+
+// The names of the page modes, in the order of the page_mode enum in definitions.h
+static char *page_mode_names[] = {"default", "4k", "thp", "2m", "1g", "hugetlbfs"};
+
+char *page_mode_name(int pages){
+  return page_mode_names[pages];
+}
+
+// Add how much of an array is resident, and how much of that is on huge pages (transparent
+// or hugetlb), in bytes, using the mappings listed in /proc/self/smaps. The counts of a
+// mapping are shared out in proportion to how much of it the array covers, so arrays that
+// share a mapping are not counted more than once.
+void get_page_coverage(void *array, size_t bytes, double *huge_bytes, double *resident_bytes){
+  FILE *fp;
+  char line[256];
+  unsigned long start, end, value;
+  unsigned long array_start = (unsigned long)array;
+  unsigned long array_end = array_start + bytes;
+  double fraction = 0;
+
+  fp = fopen("/proc/self/smaps", "r");
+  if(fp == NULL){
+    return;
+  }
+  while(fgets(line, sizeof(line), fp) != NULL){
+    // Each mapping starts with its address range, followed by its counts in kB
+    if(sscanf(line, "%lx-%lx ", &start, &end) == 2){
+      if(start < array_end && end > array_start){
+        fraction = (double)(((end < array_end) ? end : array_end) - ((start > array_start) ? start : array_start))/(end - start);
+      }else{
+        fraction = 0;
+      }
+    }else if(fraction > 0){
+      if(sscanf(line, "Rss: %lu kB", &value) == 1){
+        *resident_bytes += fraction * value * 1024;
+      }else if(sscanf(line, "AnonHugePages: %lu kB", &value) == 1 || sscanf(line, "FilePmdMapped: %lu kB", &value) == 1){
+        *huge_bytes += fraction * value * 1024;
+      }else if(sscanf(line, "Shared_Hugetlb: %lu kB", &value) == 1 || sscanf(line, "Private_Hugetlb: %lu kB", &value) == 1){
+        // Hugetlb pages are not included in Rss
+        *huge_bytes += fraction * value * 1024;
+        *resident_bytes += fraction * value * 1024;
+      }
+    }
+  }
+  fclose(fp);
+}
@@ -4,14 +4,56 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <float.h>
+#include <math.h>
 #include <string.h>
+#include <ctype.h>
+#include <unistd.h>
 #include <sys/sysinfo.h>
 #include <mxml.h>
 #if defined(__aarch64__)
 #include <sys/syscall.h>
 #endif
+#ifdef NUMA
+#include <numa.h>
+#include <sched.h>
+#endif
 
-int name_to_colour(const char *);
-int get_key();
-unsigned long get_processor_and_core(int *chip, int *core);
+// How much of a node each node communicator covers
+typedef enum {
+  whole_node,
+  socket_domain,
+  numa_domain
+} node_scope;
+
+// Quantile sketches (DDSketch): each value is counted in a bucket whose width grows
+// geometrically, so any quantile is estimated to within SKETCH_ACCURACY of its value, and two
+// sketches are merged by adding their counts (i.e. with MPI_SUM). Values below SKETCH_MIN_VALUE
+// are counted in the first bucket, and values beyond the last bucket (1.3E3 here) in the last.
+#define SKETCH_ACCURACY 0.01
+#define SKETCH_MIN_VALUE 1.0E-8
+#define SKETCH_BUCKETS 1280
 
+// Running mean and variance of a series of values, updated one value at a time
+typedef struct running_stats {
+  int count;
+  double mean;
+  // Sum of the squared differences from the mean
+  double m2;
+} running_stats;
+
+MPI_Comm get_node_comm(node_scope scope);
+void get_node_name(char *name);
+unsigned long get_processor_and_core(int *chip, int *core);
+size_t get_llc_size();
+size_t random_below(unsigned long long *state, size_t n);
+int get_numa_domain();
+int get_num_numa_domains();
+int numa_domain_has_memory(int domain);
+void get_numa_placement(void *array, size_t bytes, double *numa_pages, int max_domains);
+void get_page_coverage(void *array, size_t bytes, double *huge_bytes, double *resident_bytes);
+char *page_mode_name(int pages);
+void running_stats_add(running_stats *stats, double value);
+double running_stats_variance(running_stats *stats);
+double relative_confidence(running_stats *stats);
+void sketch_add(double *sketch, double value);
+double sketch_quantile(double *sketch, double q);